@@ -1,6 +1,14 @@
-
 #include <QtWidgets>
+#include <QtConcurrent>
 #include <QDebug>
+#include <atomic>
+#include <complex>
+#include <limits>
+#include <memory>
+#include <tuple>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
 #include <util/LightTestImplementation.h>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -43,19 +51,30 @@ public:
     void setDisplayMilliSeconds(bool arg) {mDisplayMilliSeconds = arg;}
     void setDebug(bool arg) {mDebug = arg;}
     void setByteOrder(ByteOrderMode arg) {mByteOrder = arg;}
+    void setDensity(bool arg) {mDensity = arg;}
+    void setHud(bool arg) {mHud = arg;}
+    void setRowHeight(int arg) {mRowHeight = std::max(static_cast<int>(MinRowHeight), arg);}
 
     const QString & fileName() const {return mFileName;}
     const QFont & defaultFont() const {return mDefaultFont;}
     bool displayMilliSeconds() const {return mDisplayMilliSeconds;}
     bool debug() const {return mDebug;}
+    bool density() const {return mDensity;}
+    bool hud() const {return mHud;}
+    int rowHeight() const {return mRowHeight;}
     ByteOrderMode byteOrder() const {return mByteOrder;}
+
+    enum {MinRowHeight = 24, DefaultRowHeight = 120};
 private:
     GlobalSetup():
         mFileName(),
         mDefaultFont(),
         mByteOrder(AutoByteOrder),
         mDebug(false),
-        mDisplayMilliSeconds(false)
+        mDisplayMilliSeconds(false),
+        mDensity(false),
+        mHud(false),
+        mRowHeight(DefaultRowHeight)
     {
     }
 private:
@@ -64,20 +83,246 @@ private:
     ByteOrderMode mByteOrder;
     bool mDebug;
     bool mDisplayMilliSeconds;
+    bool mDensity;
+    bool mHud;
+    int mRowHeight;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Trace
+////////////////////////////////////////////////////////////////////////////////
+
+class Trace
+{
+    // Spans and counters of all threads in release builds too, written as
+    // Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Enabled by
+    // --trace=FILE or NO_TRACE=FILE, otherwise a scope costs one atomic
+    // load. Every thread appends to an own buffer of at most MaxEvents,
+    // names are literals.
+public:
+    enum {MaxEvents = 1 << 20};
+
+    static Trace & Instance()
+    {
+        static Trace trace;
+        return trace;
+    }
+
+    bool isEnabled() const {return mIsEnabled.load(std::memory_order_relaxed);}
+    qint64 now() const {return mClock.nsecsElapsed();}
+
+    void start() {mIsEnabled = true;}
+
+    void span(const char * name, qint64 begin, qint64 end)
+    {
+        if (isEnabled()) {append(Event{name, begin, end - begin, 'X'});}
+    }
+
+    void counter(const char * name, qint64 value)
+    {
+        if (isEnabled()) {append(Event{name, now(), value, 'C'});}
+    }
+
+    // counters summed up over all threads (e.g. decoded samples): every
+    // thread records its deltas, write() sums them up in time order
+    void add(const char * name, qint64 delta)
+    {
+        if (isEnabled()) {append(Event{name, now(), delta, 'A'});}
+    }
+
+    // The thread pools besides the global one: owned by the trace, so
+    // that Session waits for all threads which may trace.
+    QThreadPool & newPool(int threads)
+    {
+        QMutexLocker lock(&mMutex);
+        mPools.push_back(std::unique_ptr<QThreadPool>(new QThreadPool()));
+        mPools.back()->setMaxThreadCount(threads);
+        return *mPools.back();
+    }
+
+    // the tasks of the own pools may start tasks on the global one
+    void waitForPools()
+    {
+        std::vector<QThreadPool *> pools;
+        {
+            QMutexLocker lock(&mMutex);
+            for (auto & pool:mPools) {pools.push_back(pool.get());}
+        }
+
+        for (auto pool:pools) {pool->waitForDone();}
+        QThreadPool::globalInstance()->waitForDone();
+    }
+
+    // stops tracing and clears the buffers, an empty string or the error
+    QString write(const QString & fileName)
+    {
+        mIsEnabled = false;
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly)) return "cannot write " + fileName;
+        QTextStream out(&file);
+        QMutexLocker lock(&mMutex);
+        std::vector<std::pair<Event, int>> deltas;
+        const char * separator = "";
+        out << "{\"traceEvents\":[\n";
+
+        for (auto & buffer:mBuffers)
+        {
+            QMutexLocker events(&buffer->mutex);
+            out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread
+                << ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+            separator = ",\n";
+
+            for (auto & event:buffer->events)
+            {
+                if (event.phase == 'A') {deltas.push_back(std::make_pair(event, buffer->thread)); continue;}
+                write(out, event, buffer->thread);
+            }
+
+            if (buffer->dropped > 0) {write(out, Event{"trace events dropped", now(), buffer->dropped, 'C'}, buffer->thread);}
+            buffer->events.clear();
+            buffer->events.shrink_to_fit();
+            buffer->dropped = 0;
+        }
+
+        auto isEarlier = [](const std::pair<Event, int> & a, const std::pair<Event, int> & b) {return a.first.begin < b.first.begin;};
+        std::stable_sort(deltas.begin(), deltas.end(), isEarlier);
+        std::map<QByteArray, qint64> totals;
+
+        for (auto & delta:deltas)
+        {
+            const qint64 total = (totals[QByteArray(delta.first.name)] += delta.first.value);
+            write(out, Event{delta.first.name, delta.first.begin, total, 'C'}, delta.second);
+        }
+
+        out << "\n]}\n";
+        return (out.status() == QTextStream::Ok) ? QString() : ("cannot write " + fileName);
+    }
+
+    // traces from construction to destruction (the end of main) into
+    // fileName or NO_TRACE, all threads of all pools finished
+    class Session
+    {
+    public:
+        explicit Session(const QString & fileName):
+            mFileName(fileName.isEmpty() ? QString::fromLocal8Bit(qgetenv("NO_TRACE")) : fileName)
+        {
+            if (!mFileName.isEmpty()) {Trace::Instance().start();}
+        }
+
+        ~Session()
+        {
+            if (mFileName.isEmpty()) return;
+            Trace::Instance().waitForPools();
+            const QString error = Trace::Instance().write(mFileName);
+            if (!error.isEmpty()) {std::cerr << error.toStdString() << std::endl;}
+        }
+    private:
+        const QString mFileName;
+    };
+private:
+    struct Event
+    {
+        const char * name;
+        qint64 begin;
+        qint64 value;
+        char phase;
+    };
+
+    // events of one thread, only write() locks it as well
+    struct Buffer
+    {
+        QMutex mutex;
+        std::vector<Event> events;
+        qint64 dropped;
+        int thread;
+        QString name;
+    };
+
+    std::atomic<bool> mIsEnabled;
+    QElapsedTimer mClock;
+    QMutex mMutex;
+    std::vector<std::unique_ptr<Buffer>> mBuffers;
+    std::vector<std::unique_ptr<QThreadPool>> mPools;
+
+    Trace():
+        mIsEnabled(false),
+        mClock(),
+        mMutex(),
+        mBuffers(),
+        mPools()
+    {
+        mClock.start();
+    }
+
+    static void write(QTextStream & out, const Event & event, int thread)
+    {
+        out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase
+            << "\",\"pid\":1,\"tid\":" << thread
+            << ",\"ts\":" << QString::number(event.begin / 1e3, 'f', 3);
+        if (event.phase == 'X') {out << ",\"dur\":" << QString::number(event.value / 1e3, 'f', 3) << "}";}
+        else                    {out << ",\"args\":{\"value\":" << event.value << "}}";}
+    }
+
+    // buffers live as long as the trace, threads of pools may end earlier
+    void append(const Event & event)
+    {
+        static thread_local Buffer * local = nullptr;
+
+        if (!local)
+        {
+            const QCoreApplication * app = QCoreApplication::instance();
+            const bool isMain = app && (QThread::currentThread() == app->thread());
+            QMutexLocker lock(&mMutex);
+            mBuffers.push_back(std::unique_ptr<Buffer>(new Buffer()));
+            local = mBuffers.back().get();
+            local->dropped = 0;
+            local->thread = static_cast<int>(mBuffers.size());
+            local->name = isMain ? QString("main") : QString("worker %1").arg(local->thread);
+        }
+
+        QMutexLocker lock(&local->mutex);
+        if (local->events.size() < static_cast<size_t>(MaxEvents)) {local->events.push_back(event);}
+        else                                  {++local->dropped;}
+    }
+};
+
+class TraceScope
+{
+    // one span from construction to destruction
+public:
+    explicit TraceScope(const char * name):
+        mName(name),
+        mBegin(Trace::Instance().isEnabled() ? Trace::Instance().now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (mBegin >= 0) {Trace::Instance().span(mName, mBegin, Trace::Instance().now());}
+    }
+private:
+    const char * mName;
+    const qint64 mBegin;
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope & operator=(const TraceScope &) = delete;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 // MeasurePerformance
 ////////////////////////////////////////////////////////////////////////////////
 
+// a trace span in every build, timings on the debug output in debug builds
 #ifdef IS_DEBUG_BUILD
 class MeasurePerformance
 {
 private:
+    TraceScope mScope;
     const char * mName;
     QTime mTimer;
 public:
     MeasurePerformance(const char * name):
+        mScope(name),
         mName(name),
         mTimer()
     {
@@ -94,9 +339,13 @@ public:
 #ifdef IS_RELEASE_BUILD
 class MeasurePerformance
 {
+private:
+    TraceScope mScope;
 public:
-    MeasurePerformance(const char *) {}
-    ~MeasurePerformance() {}
+    MeasurePerformance(const char * name):
+        mScope(name)
+    {
+    }
 };
 #endif
 
@@ -171,6 +420,10 @@ public:
         if (mPosition < mChannelOffset) {return false;}
         return (mPosition < (mChannelOffset + mChannelSize));
     }
+
+    int blockSize() const {return mBlockSize;}
+    int channelOffset() const {return mChannelOffset;}
+    int channelSize() const {return mChannelSize;}
 };
 
 class InfoParser
@@ -195,7 +448,9 @@ public:
         // "+" adds the info line to an existing channel
         // "-" substract the data file from the last data
         //     file in existing channel
-        QRegularExpression find("^\\s*([>+-])\\s*");
+        // "=" creates a new channel from an expression over
+        //     the labels of earlier info lines
+        QRegularExpression find("^\\s*([>+=-])\\s*");
         QRegularExpressionMatch match = find.match(mRemaining);
         QString result(">");
 
@@ -270,1560 +525,6537 @@ public:
     }
 };
 
-class DataFile
+class SampleStats
 {
-private:
-    std::vector<int> mSamples;
-    std::vector<Annotation> mAnnotations;
-    Second mDelay;
-    double mSps;
-    double mGain;
-    QString mTxt;
-    QString mPath;
-    QString mData;
-    QString mAnno;
-    QString mOper;
-    QString mUnit;
-    QString mLabel;
-    QString mError;
-    Interleave mInterleave;
-    int mLineNumber;
-    int mSampleMask;
-    int mSampleOffset;
-    bool mIsSigned;
-    bool mIsBigEndian;
-    ByteOrderMode mByteOrderMode;
 public:
-    DataFile & operator=(const DataFile &) = default;
-    DataFile(const DataFile &) = default;
-    DataFile() = delete;
-    explicit DataFile(const QString & txt, const QString & path = "", int line = -1):
-        mSamples(),
-        mDelay(0.0),
-        mSps(0.0),
-        mGain(1.0),
-        mTxt(txt),
-        mPath(path),
-        mData(),
-        mAnno(),
-        mOper(),
-        mUnit(),
-        mLabel(),
-        mError(),
-        mLineNumber(line),
-        mSampleMask(0xffff),
-        mSampleOffset(0),
-        mIsSigned(true),
-        mIsBigEndian(true),
-        mByteOrderMode(GlobalSetup::Instance().byteOrder())
+    qint64 count;
+    int min;
+    int max;
+    qint64 sum;
+    double squares;
+
+    SampleStats():
+        count(0),
+        min(INT_MAX),
+        max(INT_MIN),
+        sum(0),
+        squares(0)
     {
-        parseInfo();
-        readData();
-        readAnno();
-        debug();
     }
 
-    int lineNumber() const
+    void add(const int * samples, qint64 size)
     {
-        return mLineNumber;
+        qint64 squareSum = 0;
+
+        for (qint64 index = 0; index < size; ++index)
+        {
+            const int lsb = samples[index];
+            if (min > lsb) min = lsb;
+            if (max < lsb) max = lsb;
+            sum += lsb;
+            squareSum += static_cast<qint64>(lsb) * lsb;
+        }
+
+        count += size;
+        squares += static_cast<double>(squareSum);
     }
 
-    int sampleMask() const
+    void add(const SampleStats & other)
     {
-        return mSampleMask;
+        if (min > other.min) min = other.min;
+        if (max < other.max) max = other.max;
+        count += other.count;
+        sum += other.sum;
+        squares += other.squares;
     }
 
-    int sampleOffset() const
+    double mean() const
     {
-        return mSampleOffset;
+        return (count > 0) ? (static_cast<double>(sum) / count) : 0;
     }
 
-    double gain() const
+    double rms() const
     {
-        return mGain;
+        return (count > 0) ? std::sqrt(squares / count) : 0;
     }
+};
 
-    double sps() const
+class RangeStats
+{
+private:
+    // Summary of blocks with 2^mBlockShift samples:
+    // - mLevels[0] holds min/max per block, mLevels[n] combines 2^n blocks
+    // - prefix sums of samples and squared samples over whole blocks
+    struct Node {int min; int max;};
+    int mBlockShift;
+    qint64 mSize;
+    std::vector<std::vector<Node>> mLevels;
+    std::vector<qint64> mSums;
+    std::vector<double> mSquares;
+public:
+    explicit RangeStats(int blockShift = 6):
+        mBlockShift(blockShift),
+        mSize(0),
+        mLevels(),
+        mSums(),
+        mSquares()
     {
-        return mSps;
     }
 
-    Second delay() const
+    qint64 blockSize() const
     {
-        return mDelay;
+        return static_cast<qint64>(1) << mBlockShift;
     }
 
-    Second duration() const
+    void build(const std::vector<int> & samples)
     {
-        return delay() + static_cast<double>(mSamples.size()) / sps();
+        mSize = static_cast<qint64>(samples.size());
+        const qint64 blocks = mSize >> mBlockShift;
+        std::vector<Node> level;
+        level.reserve(blocks);
+        mLevels.clear();
+        mSums.assign(1, 0);
+        mSquares.assign(1, 0);
+
+        for (qint64 block = 0; block < blocks; ++block)
+        {
+            SampleStats stats;
+            stats.add(&samples[block << mBlockShift], blockSize());
+            level.push_back(Node{stats.min, stats.max});
+            mSums.push_back(mSums.back() + stats.sum);
+            mSquares.push_back(mSquares.back() + stats.squares);
+        }
+
+        while (level.size() > 0)
+        {
+            std::vector<Node> next;
+            next.reserve((level.size() + 1) / 2);
+
+            for (size_t index = 0; index < level.size(); index += 2)
+            {
+                Node node = level[index];
+                if ((index + 1) < level.size())
+                {
+                    node.min = std::min(node.min, level[index + 1].min);
+                    node.max = std::max(node.max, level[index + 1].max);
+                }
+                next.push_back(node);
+            }
+
+            mLevels.push_back(level);
+            if (level.size() < 2) break;
+            level.swap(next);
+        }
     }
 
-    const std::vector<int> & samples() const
+    // Statistics of samples[begin, end). Only the partial blocks at both
+    // ends are scanned, whole blocks cost O(1) for sums, O(log n) for min/max.
+    SampleStats query(const int * samples, qint64 begin, qint64 end) const
     {
-        return mSamples;
-    }
+        SampleStats result;
+        if (begin < 0) begin = 0;
+        if (end > mSize) end = mSize;
+        if (begin >= end) return result;
 
-    const std::vector<Annotation> & annotations() const
+        const qint64 mask = blockSize() - 1;
+        qint64 first = (begin + mask) >> mBlockShift;
+        qint64 last = end >> mBlockShift;
+
+        if (first >= last)
+        {
+            result.add(samples + begin, end - begin);
+            return result;
+        }
+
+        result.add(samples + begin, (first << mBlockShift) - begin);
+        result.add(samples + (last << mBlockShift), end - (last << mBlockShift));
+        result.count += (last - first) << mBlockShift;
+        result.sum += mSums[last] - mSums[first];
+        result.squares += mSquares[last] - mSquares[first];
+
+        for (size_t level = 0; (level < mLevels.size()) && (first < last); ++level)
+        {
+            const std::vector<Node> & nodes = mLevels[level];
+            if (first & 1) {merge(result, nodes[first]); ++first;}
+            if (last & 1)  {--last; merge(result, nodes[last]);}
+            first >>= 1;
+            last >>= 1;
+        }
+
+        return result;
+    }
+private:
+    static void merge(SampleStats & dst, const Node & node)
     {
-        return mAnnotations;
+        if (dst.min > node.min) dst.min = node.min;
+        if (dst.max < node.max) dst.max = node.max;
     }
+};
 
-    bool valid() const
+////////////////////////////////////////////////////////////////////////////////
+// SampleStore
+////////////////////////////////////////////////////////////////////////////////
+
+struct SampleBlock
+{
+    std::vector<int> samples;
+    RangeStats stats;
+};
+
+typedef std::shared_ptr<const SampleBlock> SampleBlockPtr;
+
+class BlockCache
+{
+public:
+    static BlockCache & Instance()
     {
-        return (error().size() == 0);
+        static BlockCache cache;
+        return cache;
     }
 
-    const QString & error() const
+    SampleBlockPtr find(quint64 store, qint64 block)
     {
-        return mError;
+        QMutexLocker lock(&mMutex);
+        auto it = mBlocks.find(Key(store, block));
+
+        if (it == mBlocks.end())
+        {
+            ++mMisses;
+            return SampleBlockPtr();
+        }
+
+        ++mHits;
+        mOrder.splice(mOrder.begin(), mOrder, it->second.order);
+        return it->second.block;
     }
 
-    const QString & txt() const
+    void insert(quint64 store, qint64 block, const SampleBlockPtr & data)
     {
-        return mTxt;
+        QMutexLocker lock(&mMutex);
+        const Key key(store, block);
+        if (mBlocks.count(key) > 0) return;
+        mOrder.push_front(key);
+        const Entry entry = {data, mOrder.begin()};
+        mBlocks.insert(std::make_pair(key, entry));
+        mBytes += bytes(*data);
+        evict();
     }
 
-    const QString & unit() const
+    void remove(quint64 store)
     {
-        return mUnit;
+        QMutexLocker lock(&mMutex);
+        auto it = mBlocks.lower_bound(Key(store, 0));
+
+        while ((it != mBlocks.end()) && (it->first.first == store))
+        {
+            mBytes -= bytes(*it->second.block);
+            mOrder.erase(it->second.order);
+            it = mBlocks.erase(it);
+        }
     }
 
-    const QString & label() const
+    void setBudget(qint64 bytes)
     {
-        return mLabel;
+        QMutexLocker lock(&mMutex);
+        mBudget = bytes;
+        evict();
     }
 
-    bool isOperator(const QString & arg) const
+    qint64 budget() const {QMutexLocker lock(&mMutex); return mBudget;}
+    qint64 hits() const {QMutexLocker lock(&mMutex); return mHits;}
+    qint64 misses() const {QMutexLocker lock(&mMutex); return mMisses;}
+private:
+    typedef std::pair<quint64, qint64> Key;
+    struct Entry {SampleBlockPtr block; std::list<Key>::iterator order;};
+
+    mutable QMutex mMutex;
+    std::map<Key, Entry> mBlocks;
+    std::list<Key> mOrder;
+    qint64 mBytes;
+    qint64 mBudget;
+    qint64 mHits;
+    qint64 mMisses;
+
+    BlockCache():
+        mMutex(),
+        mBlocks(),
+        mOrder(),
+        mBytes(0),
+        mBudget(static_cast<qint64>(512) << 20),
+        mHits(0),
+        mMisses(0)
     {
-        return (mOper == arg);
     }
 
-    void minus(const DataFile & other)
+    static qint64 bytes(const SampleBlock & block)
     {
-        std::vector<int> result;
-        Second time = 0;
-        size_t index = 0;
+        return static_cast<qint64>(block.samples.capacity() * sizeof(int) + sizeof(block));
+    }
 
-        while (time < duration())
+    void evict()
+    {
+        // least recently used blocks first, but keep the newest one
+        while ((mBytes > mBudget) && (mOrder.size() > 1))
         {
-            double a = at(time);
-            double b = other.at(time);
-            if (std::isnan(a)) {a = 0;}
-            if (std::isnan(b)) {b = 0;}
-            const int lsb = static_cast<int>((a - b) / gain());
-            result.push_back(lsb);
-            ++index;
-            time = static_cast<Second>(index) / sps();
+            auto it = mBlocks.find(mOrder.back());
+            mBytes -= bytes(*it->second.block);
+            mBlocks.erase(it);
+            mOrder.pop_back();
         }
+    }
+};
 
-        mSamples = result;
-        mDelay = 0;
-        mLabel = label() + "-" + other.label();
+class SampleStore
+{
+    // Samples are organized in blocks of BlockSize. Derived stores compute
+    // blocks on demand. Computed blocks live in the shared BlockCache, the
+    // statistics of every computed block stay resident (mSummaries).
+public:
+    enum {BlockShift = 14, BlockSize = 1 << BlockShift};
+
+    SampleStore():
+        mId(nextId()),
+        mMutex(),
+        mSummaries()
+    {
     }
 
-    int clipIndex(int index) const
+    virtual ~SampleStore()
     {
-        const int max = static_cast<int>(samples().size()) - 1;
-        if (index > max) return max;
-        if (index < 0) return 0;
-        return index;
+        BlockCache::Instance().remove(mId);
     }
 
-    struct MinMax {double min; double max;};
-    MinMax minmax(int indexBegin, int indexEnd) const
+    virtual qint64 size() const = 0;
+
+    virtual int at(qint64 index) const
     {
-        MinMax result = {0, 0};
-        if (samples().size() < 1) return result;
+        const SampleBlockPtr data = block(index >> BlockShift);
+        return data->samples[static_cast<size_t>(index & (BlockSize - 1))];
+    }
 
-        Q_ASSERT(indexBegin <= indexEnd);
-        auto begin = samples().begin() + clipIndex(indexBegin);
-        auto end = samples().begin() + clipIndex(indexEnd);
-        auto mm = std::minmax_element(begin, end);
-        auto one = gain() * (*mm.first);
-        auto two = gain() * (*mm.second);
+    // samples[begin, end) clipped to the valid range
+    virtual void read(qint64 begin, qint64 end, std::vector<int> & dst) const
+    {
+        dst.clear();
+        if (begin < 0) begin = 0;
+        if (end > size()) end = size();
+        if (begin >= end) return;
+        dst.reserve(static_cast<size_t>(end - begin));
 
-        if (gain() > 0)
+        for (qint64 index = begin; index < end;)
         {
-            result.min = one;
-            result.max = two;
-            return result;
+            const qint64 blockIndex = index >> BlockShift;
+            const qint64 blockEnd = std::min(end, (blockIndex + 1) << BlockShift);
+            const SampleBlockPtr data = block(blockIndex);
+            auto first = data->samples.begin() + (index & (BlockSize - 1));
+            dst.insert(dst.end(), first, first + (blockEnd - index));
+            index = blockEnd;
         }
-
-        result.max = two;
-        result.min = one;
-        return result;
     }
 
-private:
-    double at(Second sec) const
+    // true if all samples are in memory anyway (no block computation)
+    virtual bool isResident() const
     {
-        const size_t index = static_cast<size_t>((sec - delay()) * sps());
-        return (index < samples().size())
-            ? (gain() * samples()[index])
-            : NAN;
+        return false;
     }
 
-    void readAnno()
+    // Computes all blocks of [begin, end) of all stores in parallel,
+    // later reads are served from the BlockCache.
+    static void computeParallel(
+            const std::vector<std::shared_ptr<const SampleStore>> & stores,
+            qint64 begin, qint64 end)
     {
-        if (mAnno.size() < 1) return;
-        const bool isAbsPath = mAnno.startsWith('/');
-        const QString name = (isAbsPath ? mAnno : (mPath + mAnno));
-        QFile read(name);
+        struct Task {const SampleStore * store; qint64 block;};
+        std::vector<Task> tasks;
 
-        if (!read.open(QIODevice::ReadOnly))
+        for (auto & store:stores)
         {
-            error("anno file missing: " + name);
-            return;
+            if (store->isResident()) continue;
+            const qint64 last = std::min(end, store->size());
+            for (qint64 block = (begin >> BlockShift); (block << BlockShift) < last; ++block)
+            {
+                tasks.push_back(Task{store.get(), block});
+            }
         }
 
-        QTextStream stream(&read);
-        QRegularExpression re("^\\s*(\\S+)\\s+(.+)\\s*$");
+        QtConcurrent::blockingMap(tasks, [](Task & task) {task.store->block(task.block);});
+    }
 
-        while (!stream.atEnd())
+    virtual SampleStats stats(qint64 begin, qint64 end) const
+    {
+        SampleStats result;
+        if (begin < 0) begin = 0;
+        if (end > size()) end = size();
+
+        for (qint64 index = begin; index < end;)
         {
-            const QString line = stream.readLine();
-            QRegularExpressionMatch match = re.match(line);
+            const qint64 blockIndex = index >> BlockShift;
+            const qint64 blockBegin = blockIndex << BlockShift;
+            const qint64 blockEnd = std::min(size(), blockBegin + BlockSize);
+            const qint64 rangeEnd = std::min(end, blockEnd);
 
-            if (match.hasMatch())
+            if ((index != blockBegin) || (rangeEnd != blockEnd) || !summary(blockIndex, result))
             {
-                bool valid = true;
-                const Annotation anno(match.captured(1).toDouble(&valid), match.captured(2));
-                if (valid) {mAnnotations.push_back(anno);}
-            }
-            else
-            {
-                qDebug() << "anno error:" << line;
+                const SampleBlockPtr data = block(blockIndex);
+                result.add(data->stats.query(data->samples.data(),
+                            index - blockBegin, rangeEnd - blockBegin));
             }
+
+            index = rangeEnd;
         }
 
-        read.close();
+        return result;
     }
+protected:
+    virtual void compute(qint64 blockIndex, std::vector<int> & dst) const = 0;
 
-    void debug() const
+    SampleBlockPtr block(qint64 blockIndex) const
     {
-        if (!GlobalSetup::Instance().debug()) return;
-        QTextStream out(stdout);
-        const QString bo = mIsBigEndian
-            ? (mIsSigned ? "bei16" : "beu16")
-            : (mIsSigned ? "lei16" : "leu16");
-        out << mLabel;
-        out << "|" << bo;
-        out << "|mask=0x" << hex << mSampleMask;
-        out << "|offset=0x" << hex << mSampleOffset;
-        out << "|delay=" << dec << mDelay;
-        out << endl;
+        SampleBlockPtr result = cached(blockIndex);
+        if (result) return result;
+
+        std::shared_ptr<SampleBlock> data = std::make_shared<SampleBlock>();
+        compute(blockIndex, data->samples);
+        data->stats.build(data->samples);
+        remember(blockIndex, data->samples);
+        BlockCache::Instance().insert(mId, blockIndex, data);
+        return data;
     }
 
-    void readData()
+    // null unless the block is in the BlockCache
+    SampleBlockPtr cached(qint64 blockIndex) const
     {
-        readData(mSamples, mIsBigEndian);
-        if (mByteOrderMode == AutoByteOrder) autoByteOrder();
+        return BlockCache::Instance().find(mId, blockIndex);
     }
 
-    void autoByteOrder()
+    // the resident statistics of a block without caching its samples
+    void summarize(qint64 blockIndex) const
     {
-        std::vector<int> swap;
-        readData(swap, !mIsBigEndian);
+        SampleStats known;
+        if (summary(blockIndex, known)) return;
+        std::vector<int> samples;
+        compute(blockIndex, samples);
+        remember(blockIndex, samples);
+    }
+private:
+    const quint64 mId;
+    mutable QMutex mMutex;
+    mutable std::vector<SampleStats> mSummaries;
 
-        const size_t size = swap.size();
-        Q_ASSERT(mSamples.size() == size);
-        if (size < 2) return;
+    static quint64 nextId()
+    {
+        static std::atomic<quint64> id(0);
+        return ++id;
+    }
 
-        int compare = 0;
-        auto o1 = mSamples.begin();
-        auto o2 = o1 + 1;
-        auto s1 = swap.begin();
-        auto s2 = s1 + 1;
+    void remember(qint64 blockIndex, const std::vector<int> & samples) const
+    {
+        SampleStats total;
+        total.add(samples.data(), static_cast<qint64>(samples.size()));
+        QMutexLocker lock(&mMutex);
+        const size_t index = static_cast<size_t>(blockIndex);
+        if (mSummaries.size() <= index) {mSummaries.resize(index + 1);}
+        mSummaries[index] = total;
+    }
 
-        // Idea: The difference between 2 samples is usually small (e.g. ECG baseline
-        // sections) but can increase dramatically when assuming the wrong byte order.
-        for (size_t index = 1; index < size; ++index, ++o1, ++o2, ++s1, ++s2)
-        {
-            const int diffOrig = (*o1) - (*o2);
-            const int diffSwap = (*s1) - (*s2);
-            const int cmp = std::abs(diffOrig) - std::abs(diffSwap);
-            if (cmp > 0) ++compare;
-            if (cmp < 0) --compare;
-        }
+    bool summary(qint64 blockIndex, SampleStats & dst) const
+    {
+        QMutexLocker lock(&mMutex);
+        const size_t index = static_cast<size_t>(blockIndex);
+        if (index >= mSummaries.size()) return false;
+        if (mSummaries[index].count < 1) return false;
+        dst.add(mSummaries[index]);
+        return true;
+    }
+};
 
-        if (compare > 0)
-        {
-            qDebug() << "autoByteOrder: swap" << mData;
-            mIsBigEndian = !mIsBigEndian;
-            mSamples = swap;
-        }
+class MemoryStore : public SampleStore
+{
+private:
+    const std::vector<int> mSamples;
+    RangeStats mStats;
+public:
+    explicit MemoryStore(std::vector<int> && samples):
+        mSamples(std::move(samples)),
+        mStats()
+    {
+        mStats.build(mSamples);
     }
 
-    void readData(std::vector<int> & dst, bool isBigEndian)
+    qint64 size() const override
     {
-        mInterleave.first();
-        dst.clear();
+        return static_cast<qint64>(mSamples.size());
+    }
 
-        if (mData == "dummy") return;
-        if (mData.size() < 1) return;
-        const bool isAbsPath = mData.startsWith('/');
-        const QString name = (isAbsPath ? (mData) : (mPath + mData));
-        QFile read(name);
+    int at(qint64 index) const override
+    {
+        return mSamples[static_cast<size_t>(index)];
+    }
 
-        if (!read.open(QIODevice::ReadOnly))
-        {
-            error("data file missing: " + name);
-            return;
-        }
+    void read(qint64 begin, qint64 end, std::vector<int> & dst) const override
+    {
+        dst.clear();
+        if (begin < 0) begin = 0;
+        if (end > size()) end = size();
+        if (begin >= end) return;
+        dst.assign(mSamples.begin() + begin, mSamples.begin() + end);
+    }
 
-        const size_t size = static_cast<size_t>(QFileInfo(name).size());
-        dst.reserve(size / sizeof(qint16));
-        QDataStream stream(&read);
-        stream.setByteOrder(isBigEndian ? QDataStream::BigEndian : QDataStream::LittleEndian);
+    SampleStats stats(qint64 begin, qint64 end) const override
+    {
+        return mStats.query(mSamples.data(), begin, end);
+    }
 
-        while (!stream.atEnd())
-        {
-            int lsb;
-            if (mIsSigned)
-            {
-                const qint16 mask = static_cast<qint16>(mSampleMask);
-                qint16 sample;
-                stream >> sample;
-                lsb = static_cast<int>(sample & mask) - mSampleOffset;
-            }
-            else
-            {
-                const quint16 mask = static_cast<quint16>(mSampleMask);
-                quint16 sample;
-                stream >> sample;
-                lsb = static_cast<int>(sample & mask) - mSampleOffset;
-            }
+    bool isResident() const override
+    {
+        return true;
+    }
+protected:
+    void compute(qint64 blockIndex, std::vector<int> & dst) const override
+    {
+        read(blockIndex << BlockShift, (blockIndex + 1) << BlockShift, dst);
+    }
+};
 
-            if (mInterleave.isUsed())
-            {
-                dst.push_back(lsb);
-            }
+struct SampleFormat
+{
+    // 16 bit words, masked and offset. A frame of frameSize words holds
+    // channelSize words of the channel at channelOffset.
+    bool isSigned;
+    bool isBigEndian;
+    int mask;
+    int offset;
+    int frameSize;
+    int channelOffset;
+    int channelSize;
 
-            mInterleave.next();
-        }
+    int decode(const uchar * word) const
+    {
+        const quint16 raw = isBigEndian ? qFromBigEndian<quint16>(word) : qFromLittleEndian<quint16>(word);
+        if (isSigned) return (static_cast<qint16>(raw) & static_cast<qint16>(mask)) - offset;
+        return (raw & static_cast<quint16>(mask)) - offset;
+    }
 
-        read.close();
+    qint64 sampleCount(qint64 words) const
+    {
+        if ((frameSize < 1) || (channelSize < 1)) return 0;
+        const qint64 used = std::max(0, std::min(channelSize, frameSize - channelOffset));
+        const qint64 rest = std::min(used, std::max<qint64>(0, (words % frameSize) - channelOffset));
+        return (words / frameSize) * used + rest;
     }
 
-    void error(const QString & tag)
+    // word index of a sample
+    qint64 word(qint64 index) const
+    {
+        return (index / channelSize) * frameSize + channelOffset + (index % channelSize);
+    }
+};
+
+class PagedStore : public SampleStore
+{
+    // Samples decoded from the data file block by block when needed, for
+    // recordings larger than memory. Only blocks in the BlockCache hold
+    // samples. The statistics of every block stay resident: index() fills
+    // them in the background, so zoomed out views do not decode the file
+    // again. The file is opened once and mapped to memory, single words
+    // (at()) are plain reads of the mapping.
+private:
+    const QString mName;
+    const SampleFormat mFormat;
+    const qint64 mSize;
+    mutable QMutex mMutex;
+    mutable QFile mFile;
+    mutable const uchar * mMap;
+    mutable bool mIsOpen;
+public:
+    explicit PagedStore(const QString & name, const SampleFormat & format):
+        mName(name),
+        mFormat(format),
+        mSize(format.sampleCount(QFileInfo(name).size() / 2)),
+        mMutex(),
+        mFile(name),
+        mMap(nullptr),
+        mIsOpen(false)
     {
-        QTextStream(&mError) << tag << endl;
     }
 
-    double toDouble(const QString & src, const QString & tag)
+    qint64 size() const override
     {
-        bool done = true;
-        const double result = src.toDouble(&done);
-        if (done) return result;
-        error(tag);
-        return 1;
+        return mSize;
     }
 
-    int toInt(int base, const QString & src, const QString & tag)
+    int at(qint64 index) const override
     {
-        bool done = true;
-        const int result = src.toInt(&done, base);
-        if (done) return result;
-        error(tag);
-        return 1;
+        const SampleBlockPtr data = cached(index >> BlockShift);
+        if (data) return data->samples[static_cast<size_t>(index & (BlockSize - 1))];
+
+        // sparse access (e.g. zoomed out drawing) reads single words
+        if ((index < 0) || (index >= size())) return 0;
+        const uchar * map = mapped();
+        if (map) return mFormat.decode(map + 2 * mFormat.word(index));
+        std::vector<int> dst;
+        decode(index, index + 1, dst);
+        return dst.empty() ? 0 : dst[0];
     }
 
-    void parseInfo()
+    static void index(const std::shared_ptr<const PagedStore> & store)
     {
-        InfoParser parser(mTxt);
-        mOper = parser.oper();
-        mData = parser.pop();
-        mSps  = toDouble(parser.pop(), "SampleFrequency");
-        double gainDividend = 1.0;
-        const double gainDivisor = toDouble(parser.pop(), "Divider");
-        mUnit = parser.pop();
-        mLabel = parser.unquoted(parser.pop());
+        // stops as soon as the last user is gone, one file after the other
+        // on a thread of its own: drawing and beat detections come first
+        const std::weak_ptr<const PagedStore> weak(store);
+        const qint64 blocks = (store->size() + BlockSize - 1) >> BlockShift;
 
-        QString dst;
-        if (parser.value(dst, "anno_file")) {mAnno = dst;}
-        if (parser.value(dst, "s-mask"))    {mSampleMask = toInt(16, dst, "s-mask");}
-        if (parser.value(dst, "offset"))    {mSampleOffset = toInt(0, dst, "offset");}
-        if (parser.value(dst, "delay"))     {mDelay = toDouble(dst, "delay") / 1000.0;}
-        if (parser.value(dst, "gain"))      {gainDividend = toDouble(dst, "gain");}
+        QtConcurrent::run(&IndexPool(), [weak, blocks]()
+        {
+            QThread::currentThread()->setPriority(QThread::LowestPriority);
 
-        mGain = gainDividend / gainDivisor;
+            for (qint64 block = 0; block < blocks; ++block)
+            {
+                const std::shared_ptr<const PagedStore> store = weak.lock();
+                if (!store) break;
+                store->summarize(block);
+            }
 
-        if (mSampleMask == 0x3fff)
+            QThread::currentThread()->setPriority(QThread::NormalPriority);
+        });
+    }
+protected:
+    void compute(qint64 blockIndex, std::vector<int> & dst) const override
+    {
+        decode(blockIndex << BlockShift, (blockIndex + 1) << BlockShift, dst);
+    }
+private:
+    static QThreadPool & IndexPool()
+    {
+        static QThreadPool & pool = Trace::Instance().newPool(1);
+        return pool;
+    }
+
+    // the whole file in memory, nullptr where it cannot be mapped
+    const uchar * mapped() const
+    {
+        QMutexLocker lock(&mMutex);
+
+        if (!mIsOpen)
         {
-            // Many info files do not contain any of the u16/i16 keywords. Thus we are
-            // guessing and testing for other typical properties of unsigned ecg samples.
-            mIsSigned = ((mSampleOffset != 0x1fff) && (mSampleOffset != 0x2000));
+            mIsOpen = true;
+            if (mFile.open(QIODevice::ReadOnly)) {mMap = mFile.map(0, mFile.size());}
         }
 
-        // Hint: Avoid these keywords. They describe only a part of the data.
-        if (parser.tag("swab"))  {mIsBigEndian = !mIsBigEndian;}
-        if (parser.tag("u16"))   {mIsSigned = false;}
-        if (parser.tag("i16"))   {mIsSigned = true;}
+        return mMap;
+    }
 
-        bool keep = false;
-        // Hint: Use these keywords instead: They fully describe the data.
-        if (parser.tag("beu16")) {keep = true; mIsSigned = false; mIsBigEndian = true;}
-        if (parser.tag("leu16")) {keep = true; mIsSigned = false; mIsBigEndian = false;}
-        if (parser.tag("bei16")) {keep = true; mIsSigned = true;  mIsBigEndian = true;}
-        if (parser.tag("lei16")) {keep = true; mIsSigned = true;  mIsBigEndian = false;}
+    // all words of samples[begin, end), from the mapping or one read
+    void decode(qint64 begin, qint64 end, std::vector<int> & dst) const
+    {
+        dst.clear();
+        if (begin < 0) begin = 0;
+        if (end > size()) end = size();
+        if (begin >= end) return;
 
-        if (keep)
+        const qint64 first = mFormat.word(begin);
+        const qint64 last = mFormat.word(end - 1);
+        const uchar * map = mapped();
+        QByteArray bytes;
+
+        if (map)
         {
-            // neither swapping nor auto-detecting
-            mByteOrderMode = KeepByteOrder;
+            bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(map + 2 * first), 2 * (last - first + 1));
         }
-        else if (mByteOrderMode == SwapByteOrder)
+        else
         {
-            mIsBigEndian = !mIsBigEndian;
+            QMutexLocker lock(&mMutex);
+            if (mFile.isOpen() && mFile.seek(2 * first)) {bytes = mFile.read(2 * (last - first + 1));}
         }
 
-        mInterleave.parse(parser.remaining());
+        const uchar * words = reinterpret_cast<const uchar *>(bytes.constData());
+        dst.reserve(static_cast<size_t>(end - begin));
+        Trace::Instance().add("samples decoded", end - begin);
+
+        for (qint64 index = begin; index < end; ++index)
+        {
+            const qint64 offset = 2 * (mFormat.word(index) - first);
+            dst.push_back(((offset + 1) < bytes.size()) ? mFormat.decode(words + offset) : 0);
+        }
     }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
-// class DataChannel
+// FilterStore
 ////////////////////////////////////////////////////////////////////////////////
 
-class DataChannel
+struct FilterSetup
 {
-private:
-    Second mDuration;
-    std::vector<DataFile> mFiles;
-    std::vector<MergedAnnotation> mMergedAnnotations;
-public:
-    void plus(DataFile & file)
+    // info file keywords, all frequencies in Hz:
+    // hp=0.5 lp=40 notch=50 median=20 (window in ms)
+    double highPass;
+    double lowPass;
+    double notch;
+    double median;
+
+    FilterSetup():
+        highPass(0),
+        lowPass(0),
+        notch(0),
+        median(0)
     {
-        mFiles.push_back(file);
     }
 
-    void minus(const DataFile & file)
+    bool isUsed() const
     {
-        if (files().size() < 1) return;
-        const size_t index = files().size() - 1;
-        mFiles[index].minus(file);
+        return (highPass > 0) || (lowPass > 0) || (notch > 0) || (median > 0);
     }
+};
 
-    void done()
-    {
-        if (files().size() < 1)
+class Biquad
+{
+private:
+    double mB0;
+    double mB1;
+    double mB2;
+    double mA1;
+    double mA2;
+public:
+    enum Type {LowPass, HighPass, Notch};
+
+    explicit Biquad(Type type, double sps, double hz, double q):
+        mB0(1),
+        mB1(0),
+        mB2(0),
+        mA1(0),
+        mA2(0)
+    {
+        // coefficients from the "Audio EQ Cookbook" (R. Bristow-Johnson)
+        const double w0 = 2 * M_PI * hz / sps;
+        const double cosw = std::cos(w0);
+        const double alpha = std::sin(w0) / (2 * q);
+        const double a0 = 1 + alpha;
+        double b0 = 1;
+        double b1 = -2 * cosw;
+        double b2 = 1;
+
+        switch (type)
         {
-            mDuration = 0;
-            return;
+        case LowPass:  b0 = (1 - cosw) / 2; b1 = 1 - cosw;    b2 = b0; break;
+        case HighPass: b0 = (1 + cosw) / 2; b1 = -(1 + cosw); b2 = b0; break;
+        case Notch:    break;
         }
 
-        size_t index = 0;
-        mMergedAnnotations.clear();
-        mDuration = files()[0].duration();
+        mB0 = b0 / a0;
+        mB1 = b1 / a0;
+        mB2 = b2 / a0;
+        mA1 = (-2 * cosw) / a0;
+        mA2 = (1 - alpha) / a0;
+    }
 
-        for (auto & file:files())
-        {
-            if (mDuration < file.duration()) {mDuration = file.duration();}
+    // forward and backward pass: zero phase, the waves keep their timing
+    void filtfilt(std::vector<double> & data) const
+    {
+        if (data.size() < 1) return;
+        run(data.begin(), data.end());
+        run(data.rbegin(), data.rend());
+    }
 
-            for (auto & anno:file.annotations())
-            {
-                MergedAnnotation ma{anno, index};
-                ma.annotation.addDelay(file.delay());
-                mMergedAnnotations.push_back(ma);
-            }
+    // one sample of a continuous stream, z1 and z2 hold the state
+    double step(double x, double & z1, double & z2) const
+    {
+        const double y = mB0 * x + z1;
+        z1 = mB1 * x - mA1 * y + z2;
+        z2 = mB2 * x - mA2 * y;
+        return y;
+    }
+private:
+    template <typename Iterator>
+    void run(Iterator begin, Iterator end) const
+    {
+        // transposed direct form II, starting in the steady state of the
+        // first sample to avoid a step response at the start of the data
+        const double x0 = *begin;
+        const double dc = (mB0 + mB1 + mB2) / (1 + mA1 + mA2);
+        double z2 = (mB2 - mA2 * dc) * x0;
+        double z1 = (mB1 - mA1 * dc) * x0 + z2;
 
-            ++index;
+        for (Iterator it = begin; it != end; ++it)
+        {
+            *it = step(*it, z1, z2);
         }
+    }
+};
 
-        auto cmp = [](const MergedAnnotation & a, const MergedAnnotation & b)
+class FilterStore : public SampleStore
+{
+    // Filtered view of another store. Each block is filtered with enough
+    // neighbouring samples (mMargin) for the filters to settle, so blocks
+    // are independent and only newly visible blocks need filtering.
+private:
+    enum {NotchQuality = 30};
+    const std::shared_ptr<const SampleStore> mSource;
+    std::vector<Biquad> mBiquads;
+    qint64 mMedianHalf;
+    qint64 mMargin;
+public:
+    explicit FilterStore(const std::shared_ptr<const SampleStore> & source,
+            const FilterSetup & setup, double sps):
+        mSource(source),
+        mBiquads(),
+        mMedianHalf(static_cast<qint64>(setup.median * sps / 2000.0)),
+        mMargin(0)
+    {
+        const double q = M_SQRT1_2;
+        const double nyquist = sps / 2;
+        double settle = 0;
+
+        if ((setup.highPass > 0) && (setup.highPass < nyquist))
         {
-            return a.annotation.sec() < b.annotation.sec();
-        };
+            mBiquads.push_back(Biquad(Biquad::HighPass, sps, setup.highPass, q));
+            settle = std::max(settle, 3 / setup.highPass);
+        }
 
-        std::sort(mMergedAnnotations.begin(), mMergedAnnotations.end(), cmp);
-    }
+        if ((setup.lowPass > 0) && (setup.lowPass < nyquist))
+        {
+            mBiquads.push_back(Biquad(Biquad::LowPass, sps, setup.lowPass, q));
+            settle = std::max(settle, 3 / setup.lowPass);
+        }
 
-    bool hasSamples() const
-    {
-        for (auto & file:files())
+        if ((setup.notch > 0) && (setup.notch < nyquist))
         {
-            if (file.samples().size() > 0) return true;
+            mBiquads.push_back(Biquad(Biquad::Notch, sps, setup.notch, NotchQuality));
+            settle = std::max(settle, NotchQuality / setup.notch);
         }
 
-        return false;
+        mMargin = mMedianHalf + static_cast<qint64>(std::ceil(settle * sps));
     }
-    
-    const std::vector<MergedAnnotation> & mergedAnnotations() const
+
+    qint64 size() const override
     {
-        return mMergedAnnotations;
+        return mSource->size();
     }
-    
-    const std::vector<DataFile> & files() const
+protected:
+    void compute(qint64 blockIndex, std::vector<int> & dst) const override
     {
-       return mFiles;
-    }
+        const qint64 begin = blockIndex << BlockShift;
+        const qint64 end = std::min(size(), begin + BlockSize);
+        const qint64 from = std::max(static_cast<qint64>(0), begin - mMargin);
+        const qint64 to = std::min(size(), end + mMargin);
+        std::vector<int> raw;
+        mSource->read(from, to, raw);
+        std::vector<double> data(raw.begin(), raw.end());
 
-    QString unit() const
-    {
-        if (files().size() < 1) return "";
-        if (files()[0].samples().size() < 1) return "";
-        return files()[0].unit();
+        if (mMedianHalf > 0) {median(data);}
+        for (auto & biquad:mBiquads) {biquad.filtfilt(data);}
+
+        dst.resize(static_cast<size_t>(end - begin));
+        const double * src = data.data() + (begin - from);
+        for (size_t index = 0; index < dst.size(); ++index)
+        {
+            dst[index] = static_cast<int>(std::lround(src[index]));
+        }
     }
+private:
+    void median(std::vector<double> & data) const
+    {
+        // centered moving median, the window shrinks at both ends
+        const std::vector<double> src(data);
+        const qint64 size = static_cast<qint64>(src.size());
+        std::vector<double> window;
 
-    Second duration() const {return mDuration;}
+        for (qint64 index = 0; index < size; ++index)
+        {
+            const qint64 first = std::max(static_cast<qint64>(0), index - mMedianHalf);
+            const qint64 last = std::min(size, index + mMedianHalf + 1);
+            window.assign(src.begin() + first, src.begin() + last);
+            auto middle = window.begin() + window.size() / 2;
+            std::nth_element(window.begin(), middle, window.end());
+            data[static_cast<size_t>(index)] = *middle;
+        }
+    }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
-// class DataMain
+// ResampleStore
 ////////////////////////////////////////////////////////////////////////////////
 
-class DataMain
+class ResampleStore : public SampleStore
 {
+    // Samples of another store on a different time grid. Windowed-sinc
+    // interpolation (Blackman window), tabulated for Phases fractional
+    // positions (polyphase). Values keep the lsb units of the source.
 private:
-    std::vector<DataChannel> mChannels;
-    Second mDuration;
-    QString mError;
+    enum {Phases = 256, HalfTaps = 16, MaxHalfTaps = 4096};
+    const std::shared_ptr<const SampleStore> mSource;
+    const double mStep;
+    const double mOffset;
+    const qint64 mSize;
+    int mHalf;
+    std::vector<float> mTable;
 public:
-    explicit DataMain(const QString & infoName):
-        mChannels(),
-        mDuration(0),
-        mError()
+    explicit ResampleStore(const std::shared_ptr<const SampleStore> & source,
+            double sourceSps, Second sourceDelay,
+            double sps, Second delay, qint64 size):
+        mSource(source),
+        mStep(sourceSps / sps),
+        mOffset((delay - sourceDelay) * sourceSps),
+        mSize(size),
+        mHalf(HalfTaps),
+        mTable()
+    {
+        // downsampling: lower the cutoff and widen the kernel accordingly
+        const double cutoff = std::min(1.0, 1.0 / mStep);
+        mHalf = std::min(static_cast<int>(MaxHalfTaps),
+                static_cast<int>(std::ceil(HalfTaps / cutoff)));
+        mHalf += (mHalf & 1);
+        const int taps = 2 * mHalf;
+        mTable.resize(static_cast<size_t>((Phases + 1) * taps));
+
+        for (int phase = 0; phase <= Phases; ++phase)
+        {
+            const double fraction = static_cast<double>(phase) / Phases;
+            float * row = &mTable[static_cast<size_t>(phase * taps)];
+            double sum = 0;
+
+            for (int tap = 0; tap < taps; ++tap)
+            {
+                const double x = (tap - mHalf + 1) - fraction;
+                const double arg = M_PI * cutoff * x;
+                const double sinc = (std::abs(arg) < 1e-9) ? 1.0 : (std::sin(arg) / arg);
+                const double w = M_PI * x / mHalf;
+                const double window = 0.42 + 0.5 * std::cos(w) + 0.08 * std::cos(2 * w);
+                const double value = (std::abs(x) < mHalf) ? (cutoff * sinc * window) : 0.0;
+                row[tap] = static_cast<float>(value);
+                sum += value;
+            }
+
+            // unity gain at DC for every phase
+            for (int tap = 0; tap < taps; ++tap) {row[tap] = static_cast<float>(row[tap] / sum);}
+        }
+    }
+
+    qint64 size() const override
     {
-        MeasurePerformance measure("DataMain::ctor");
-        QFile info(infoName);
+        return mSize;
+    }
+protected:
+    void compute(qint64 blockIndex, std::vector<int> & dst) const override
+    {
+        const qint64 begin = blockIndex << BlockShift;
+        const qint64 end = std::min(size(), begin + BlockSize);
+        const int taps = 2 * mHalf;
+        const qint64 first = static_cast<qint64>(std::floor(mOffset + begin * mStep)) - mHalf + 1;
+        const qint64 last = static_cast<qint64>(std::floor(mOffset + (end - 1) * mStep)) + mHalf + 1;
 
-        if (!info.open(QIODevice::ReadOnly))
+        // source samples outside of the source count as 0
+        std::vector<int> raw;
+        mSource->read(first, last, raw);
+
+        if (raw.empty())
         {
-            error("info file missing: " + infoName);
+            dst.assign(static_cast<size_t>(std::max(static_cast<qint64>(0), end - begin)), 0);
             return;
         }
 
-        const QString path = QFileInfo(info).path() + "/";
-        QTextStream in(&info);
-        std::vector<DataFile> fileList;
-        int lineNumber = 0;
+        std::vector<float> src(static_cast<size_t>(last - first), 0.0f);
+        const qint64 rawBegin = std::max(static_cast<qint64>(0), first);
+        std::copy(raw.begin(), raw.end(), src.begin() + (rawBegin - first));
 
-        while (!in.atEnd())
+        dst.resize(static_cast<size_t>(end - begin));
+        for (qint64 index = begin; index < end; ++index)
         {
-            const QString line = in.readLine();
-            ++lineNumber;
-
-            if (QRegularExpression("^#").match(line).hasMatch())
+            const double pos = mOffset + index * mStep;
+            const double base = std::floor(pos);
+            const int phase = static_cast<int>(std::lround((pos - base) * Phases));
+            const float * h = &mTable[static_cast<size_t>(phase * taps)];
+            const float * x = &src[static_cast<size_t>(static_cast<qint64>(base) - mHalf + 1 - first)];
+            float sum[4] = {0, 0, 0, 0};
+
+            // taps is a multiple of 4: four independent lanes (SIMD friendly)
+            for (int tap = 0; tap < taps; tap += 4)
             {
-                // ignore "comment" lines
-                continue;
+                sum[0] += h[tap + 0] * x[tap + 0];
+                sum[1] += h[tap + 1] * x[tap + 1];
+                sum[2] += h[tap + 2] * x[tap + 2];
+                sum[3] += h[tap + 3] * x[tap + 3];
             }
 
-            if (!QRegularExpression("\\S").match(line).hasMatch())
+            const float total = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+            dst[static_cast<size_t>(index - begin)] = static_cast<int>(std::lround(total));
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// ExpressionStore
+////////////////////////////////////////////////////////////////////////////////
+
+class Expression
+{
+    // Arithmetic over named operands, compiled to reverse polish notation:
+    //   sum     = product {("+" | "-") product}
+    //   product = unary {("*" | "/") unary}
+    //   unary   = "-" unary | primary
+    //   primary = number | name | "'" any name "'" | "(" sum ")"
+public:
+    enum Code {Operand, Constant, Add, Subtract, Multiply, Divide, Negate};
+    struct Op {Code code; int operand; double value;};
+
+    explicit Expression(const QString & txt):
+        mTxt(txt),
+        mPosition(0),
+        mDepth(0),
+        mMaxDepth(0),
+        mNames(),
+        mProgram(),
+        mError()
+    {
+        sum();
+        skipSpaces();
+        if (mError.isEmpty() && (mPosition < mTxt.size())) {fail("unexpected '" + mTxt.mid(mPosition, 1) + "'");}
+    }
+
+    bool valid() const {return mError.isEmpty();}
+    const QString & error() const {return mError;}
+    const std::vector<QString> & names() const {return mNames;}
+    const std::vector<Op> & program() const {return mProgram;}
+    int depth() const {return mMaxDepth;}
+
+    // dst[0, size) from operands[name index][0, size), stack holds depth() * size
+    void evaluate(const std::vector<const double *> & operands, int size,
+            double * stack, double * dst) const
+    {
+        // every operation is one plain loop over the chunk (vectorized)
+        int top = 0;
+
+        for (auto & op:mProgram)
+        {
+            if ((op.code == Operand) || (op.code == Constant))
             {
-                // ignore "whitespace only" lines
+                double * push = stack + top * size;
+                if (op.code == Operand) {std::copy(operands[op.operand], operands[op.operand] + size, push);}
+                else                    {std::fill(push, push + size, op.value);}
+                ++top;
                 continue;
             }
 
-            const DataFile file(line, path, lineNumber);
-            fileList.push_back(file);
-        }
-        
-        for (auto & file:fileList)
-        {
-            if (!file.valid())
+            double * b = stack + (top - 1) * size;
+
+            if (op.code == Negate)
             {
-                QString txt;
-                QTextStream(&txt) << "line " << file.lineNumber() << ": " << file.txt();
-                error(txt);
-                error(file.error());
+                for (int i = 0; i < size; ++i) {b[i] = -b[i];}
                 continue;
             }
-                
-            if (file.isOperator(">")) create(file);
-            if (file.isOperator("+")) plus(file);
-            if (file.isOperator("-")) minus(file);
-        }
 
-        mDuration = 0;
-        
-        for (auto & chan:mChannels)
-        {
-            chan.done();
-            if (mDuration < chan.duration()) {mDuration = chan.duration();}
+            double * a = stack + (top - 2) * size;
+            --top;
+
+            switch (op.code)
+            {
+            default:
+            case Add:      for (int i = 0; i < size; ++i) {a[i] += b[i];} break;
+            case Subtract: for (int i = 0; i < size; ++i) {a[i] -= b[i];} break;
+            case Multiply: for (int i = 0; i < size; ++i) {a[i] *= b[i];} break;
+            case Divide:   for (int i = 0; i < size; ++i) {a[i] /= b[i];} break;
+            }
         }
-    }
-    
-    bool valid() const {return error().size() == 0;}
-    Second duration() const {return mDuration;}
-    const QString & error() const {return mError;}
 
-    const std::vector<DataChannel> & channels() const
-    {
-       return mChannels;
+        std::copy(stack, stack + size, dst);
     }
 private:
-    void error(const QString & add)
-    {
-        QTextStream(&mError) << add << endl;
-    }
+    const QString mTxt;
+    int mPosition;
+    int mDepth;
+    int mMaxDepth;
+    std::vector<QString> mNames;
+    std::vector<Op> mProgram;
+    QString mError;
 
-    void create(DataFile & file)
+    void append(Code code, int operand = 0, double value = 0)
     {
-        DataChannel data;
-        mChannels.push_back(data);
-        plus(file);
+        const bool isPush = (code == Operand) || (code == Constant);
+        const bool isUnary = (code == Negate);
+        mDepth += isPush ? 1 : (isUnary ? 0 : -1);
+        mMaxDepth = std::max(mMaxDepth, mDepth);
+        mProgram.push_back(Op{code, operand, value});
     }
 
-    void plus(DataFile & file)
+    void fail(const QString & txt)
     {
-        if (channels().size() < 1) return;
-        const size_t index = channels().size() - 1;
-        mChannels[index].plus(file);
+        if (mError.isEmpty()) {mError = "expression " + mTxt + ": " + txt;}
+        mPosition = mTxt.size();
     }
 
-    void minus(DataFile & file)
+    void skipSpaces()
     {
-        if (channels().size() < 1) return;
-        const size_t index = channels().size() - 1;
-        mChannels[index].minus(file);
+        while ((mPosition < mTxt.size()) && mTxt[mPosition].isSpace()) {++mPosition;}
     }
-};
-
-////////////////////////////////////////////////////////////////////////////////
-// UnitScale
-////////////////////////////////////////////////////////////////////////////////
 
-class UnitScale
-{
-private:
-    const QString mUnit;
-    const double mMillimeterPerUnit;
-    double mPixelPerMillimeter;
-    double mMinData;
-    double mMaxData;
-    double mMin;
-    double mFocus;
-    int mPixelSize;
-    int mZoom;
-public:
-    explicit UnitScale(double speed, const QString & unit):
-        mUnit(unit),
-        mMillimeterPerUnit(speed),
-        mPixelPerMillimeter(0),
-        mMinData(0),
-        mMaxData(0),
-        mMin(0),
-        mFocus(0),
-        mPixelSize(0),
-        mZoom(0)
+    bool accept(QChar c)
     {
+        skipSpaces();
+        if ((mPosition >= mTxt.size()) || (mTxt[mPosition] != c)) return false;
+        ++mPosition;
+        return true;
     }
 
-    void setYResolution()
+    void sum()
     {
-        const QDesktopWidget desk;
-        setPixelPerMillimeter(desk.height(), desk.heightMM());
-    }
+        product();
 
-    void setXResolution()
-    {
-        const QDesktopWidget desk;
-        setPixelPerMillimeter(desk.width(), desk.widthMM());
+        while (valid())
+        {
+            if (accept('+'))      {product(); append(Add);}
+            else if (accept('-')) {product(); append(Subtract);}
+            else return;
+        }
     }
 
-    void setPixelPerMillimeter(double px, double mm)
+    void product()
     {
-        mPixelPerMillimeter = px / mm;
-    }
+        unary();
 
-    void setPixelSize(int px)
-    {
-        qDebug() << "UnitScale::setPixelSize" << mPixelSize << "->" << px;
-        mPixelSize = px;
-        updateAutoZoom();
+        while (valid())
+        {
+            if (accept('*'))      {unary(); append(Multiply);}
+            else if (accept('/')) {unary(); append(Divide);}
+            else return;
+        }
     }
 
-    void setFocus(double unit)
+    void unary()
     {
-        qDebug() << "UnitScale::setFocus" << unit << "min:" << min() << "max:" << max();
-        mFocus = unit;
+        if (accept('-'))
+        {
+            unary();
+            append(Negate);
+            return;
+        }
+
+        primary();
     }
 
-    void setFocusPixel(int px)
+    void primary()
     {
-        setFocus(fromPixel(px));
+        if (accept('('))
+        {
+            sum();
+            if (!accept(')')) {fail("missing ')'");}
+            return;
+        }
+
+        skipSpaces();
+        const QRegularExpression token("\\G(?:([0-9]*\\.?[0-9]+(?:[eE][-+]?[0-9]+)?)|([A-Za-z_]\\w*)|'([^']+)')");
+        const QRegularExpressionMatch match = token.match(mTxt, mPosition);
+
+        if (!match.hasMatch())
+        {
+            fail("operand expected");
+            return;
+        }
+
+        mPosition = match.capturedEnd(0);
+
+        if (!match.captured(1).isEmpty())
+        {
+            append(Constant, 0, match.captured(1).toDouble());
+            return;
+        }
+
+        const QString name = match.captured(2).isEmpty() ? match.captured(3) : match.captured(2);
+        auto it = std::find(mNames.begin(), mNames.end(), name);
+        if (it == mNames.end()) {it = mNames.insert(mNames.end(), name);}
+        append(Operand, static_cast<int>(it - mNames.begin()));
     }
+};
 
-    double millimeterToPixel(double mm) const
+class ExpressionStore : public SampleStore
+{
+    // An expression over other stores of the same time grid, in physical
+    // units (operand lsb * operand gain), stored in lsb of gain. Blocks are
+    // evaluated lazily in chunks of Chunk samples: a few small arrays, no
+    // intermediate buffers of the full length.
+private:
+    enum {Chunk = 256};
+    const std::vector<std::shared_ptr<const SampleStore>> mOperands;
+    const std::vector<double> mGains;
+    const Expression mExpression;
+    const double mGain;
+    const qint64 mSize;
+public:
+    explicit ExpressionStore(const std::vector<std::shared_ptr<const SampleStore>> & operands,
+            const std::vector<double> & gains,
+            const Expression & expression,
+            double gain, qint64 size):
+        mOperands(operands),
+        mGains(gains),
+        mExpression(expression),
+        mGain(gain),
+        mSize(size)
     {
-        return mPixelPerMillimeter * mm;
+        Q_ASSERT(expression.valid());
+        Q_ASSERT(operands.size() == expression.names().size());
+        Q_ASSERT(operands.size() == gains.size());
     }
 
-    double pixelPerUnit() const
+    qint64 size() const override
     {
-        return mPixelPerMillimeter * mmPerUnit();
+        return mSize;
     }
-
-    int toPixel(double unit) const
+protected:
+    void compute(qint64 blockIndex, std::vector<int> & dst) const override
     {
-        double result = (unit - min()) * pixelPerUnit();
-        result += (result > 0) ? 0.5 : -0.5;
-        return static_cast<int>(result);
+        const qint64 begin = blockIndex << BlockShift;
+        const qint64 end = std::min(size(), begin + BlockSize);
+        const int count = static_cast<int>(end - begin);
+        const size_t operands = mOperands.size();
+
+        // samples beyond the end of an operand count as 0
+        std::vector<std::vector<int>> raw(operands);
+        for (size_t index = 0; index < operands; ++index)
+        {
+            mOperands[index]->read(begin, end, raw[index]);
+            raw[index].resize(static_cast<size_t>(count), 0);
+        }
+
+        std::vector<double> values(operands * Chunk);
+        std::vector<double> stack(static_cast<size_t>(std::max(1, mExpression.depth())) * Chunk);
+        std::vector<double> result(Chunk);
+        std::vector<const double *> pointers(operands);
+        for (size_t index = 0; index < operands; ++index) {pointers[index] = &values[index * Chunk];}
+        dst.resize(static_cast<size_t>(count));
+
+        for (int first = 0; first < count; first += Chunk)
+        {
+            const int size = std::min(static_cast<int>(Chunk), count - first);
+
+            for (size_t index = 0; index < operands; ++index)
+            {
+                const int * src = &raw[index][static_cast<size_t>(first)];
+                double * value = &values[index * Chunk];
+                const double gain = mGains[index];
+                for (int i = 0; i < size; ++i) {value[i] = gain * src[i];}
+            }
+
+            mExpression.evaluate(pointers, size, stack.data(), result.data());
+
+            for (int i = 0; i < size; ++i)
+            {
+                const double lsb = result[static_cast<size_t>(i)] / mGain;
+                const double clipped = std::max(-2e9, std::min(2e9, lsb));
+                dst[static_cast<size_t>(first + i)] = std::isfinite(lsb) ? static_cast<int>(std::lround(clipped)) : 0;
+            }
+        }
     }
+};
 
-    double pixelToUnit(int px) const
+////////////////////////////////////////////////////////////////////////////////
+// SampleSearch
+////////////////////////////////////////////////////////////////////////////////
+
+class SampleSearch
+{
+    // Finds the next (or previous) sample with a property without visiting
+    // every sample: ranges whose min/max statistics rule out a hit are
+    // skipped as a whole. The range grows while nothing is found and
+    // shrinks around candidates down to ScanSize samples, which are scanned
+    // Lanes samples at a time without branches (SIMD friendly).
+    // Forward searches [from, size), backward [0, from], -1 if not found.
+public:
+    enum {ScanSize = 4096, Lanes = 16};
+
+    explicit SampleSearch(const SampleStore & store):
+        mStore(store),
+        mBuffer()
     {
-        return px / pixelPerUnit();
     }
 
-    double fromPixel(int px) const
+    // a sample outside of [lo, hi]
+    qint64 outside(qint64 from, int lo, int hi, bool isForward)
     {
-        return min() + pixelToUnit(px);
+        auto mayHit = [&](qint64 begin, qint64 end)
+        {
+            const SampleStats range = mStore.stats(begin, end);
+            return (range.min < lo) || (range.max > hi);
+        };
+
+        auto scan = [&](qint64 begin, qint64 end)
+        {
+            mStore.read(begin, end, mBuffer);
+            const int * x = mBuffer.data();
+            const qint64 hit = scanLanes(end - begin, isForward,
+                    [x, lo, hi](qint64 k) {return (x[k] < lo) | (x[k] > hi);});
+            return (hit < 0) ? hit : (begin + hit);
+        };
+
+        return find(from, isForward, mayHit, scan);
     }
 
-    void autoZoom(double min, double max)
+    // a sample within [lo, hi]
+    qint64 inside(qint64 from, int lo, int hi, bool isForward)
     {
-        qDebug() << "UnitScale::autoZoom" << min << max;
-        mMinData = min;
-        mMaxData = max;
-        updateAutoZoom();
-    }
-private:
-    void updateAutoZoom()
-    {
-        const double range = mMaxData - mMinData;
-        const double offset = (mMaxData + mMinData) / 2;
-        mZoom = 0;
-        if ((range > 0) && (pixelSize() > 0))
+        auto mayHit = [&](qint64 begin, qint64 end)
         {
-            while (range < unitSize()) {zoomIn();}
-            while (range > unitSize()) {zoomOut();}
-        }
-        mMin = offset - unitSize() / 2;
-        mFocus = (min() + max()) / 2;
-    }
-public:
-    void zoomIn()
-    {
-        ++mZoom;
-        mMin += (mFocus - min()) / 2;
-        qDebug() << "UnitScale::zoomIn" << mZoom;
+            const SampleStats range = mStore.stats(begin, end);
+            return (range.max >= lo) && (range.min <= hi);
+        };
+
+        auto scan = [&](qint64 begin, qint64 end)
+        {
+            mStore.read(begin, end, mBuffer);
+            const int * x = mBuffer.data();
+            const qint64 hit = scanLanes(end - begin, isForward,
+                    [x, lo, hi](qint64 k) {return (x[k] >= lo) & (x[k] <= hi);});
+            return (hit < 0) ? hit : (begin + hit);
+        };
+
+        return find(from, isForward, mayHit, scan);
     }
 
-    void zoomOut()
+    // a sample on the other side of level than its predecessor,
+    // the sides being (sample < level) and (sample >= level)
+    qint64 crossing(qint64 from, int level, bool isForward)
     {
-        --mZoom;
-        mMin -= (mFocus - min());
-        qDebug() << "UnitScale::zoomOut" << mZoom;
+        auto mayHit = [&](qint64 begin, qint64 end)
+        {
+            const SampleStats range = mStore.stats(std::max(static_cast<qint64>(0), begin - 1), end);
+            return (range.min < level) && (range.max >= level);
+        };
+
+        auto scan = [&](qint64 begin, qint64 end)
+        {
+            // the first sample has no predecessor
+            begin = std::max(static_cast<qint64>(1), begin);
+            if (begin >= end) return static_cast<qint64>(-1);
+            mStore.read(begin - 1, end, mBuffer);
+            const int * x = mBuffer.data() + 1;
+            const qint64 hit = scanLanes(end - begin, isForward,
+                    [x, level](qint64 k) {return (x[k] >= level) ^ (x[k - 1] >= level);});
+            return (hit < 0) ? hit : (begin + hit);
+        };
+
+        return find(from, isForward, mayHit, scan);
     }
 
-    void scrollLeft()
+    // The sample furthest outside of [lo, hi] within the next excursion
+    // (consecutive samples outside). The excursion at from is skipped.
+    qint64 peak(qint64 from, int lo, int hi, bool isForward)
     {
-        scroll((-1 * unitSize()) / 4);
+        const qint64 size = mStore.size();
+        from = isForward ? std::max(static_cast<qint64>(0), from) : std::min(size - 1, from);
+        if ((from < 0) || (from >= size)) return -1;
+        qint64 start = from;
+
+        if ((mStore.at(from) < lo) || (mStore.at(from) > hi))
+        {
+            start = inside(from, lo, hi, isForward);
+            if (start < 0) return -1;
+        }
+
+        const qint64 first = outside(start, lo, hi, isForward);
+        if (first < 0) return -1;
+        const qint64 behind = inside(first, lo, hi, isForward);
+        const qint64 begin = isForward ? first : (behind + 1);
+        const qint64 end = isForward ? ((behind < 0) ? size : behind) : (first + 1);
+
+        qint64 result = begin;
+        qint64 best = -1;
+        for (qint64 index = begin; index < end; index += ScanSize)
+        {
+            mStore.read(index, std::min(end, index + ScanSize), mBuffer);
+            for (size_t k = 0; k < mBuffer.size(); ++k)
+            {
+                const int x = mBuffer[k];
+                const qint64 distance = (x > hi) ? (static_cast<qint64>(x) - hi) : (static_cast<qint64>(lo) - x);
+                if (distance > best) {best = distance; result = index + static_cast<qint64>(k);}
+            }
+        }
+
+        return result;
     }
+private:
+    const SampleStore & mStore;
+    std::vector<int> mBuffer;
 
-    void scrollRight()
+    template <typename MayHit, typename Scan>
+    qint64 find(qint64 from, bool isForward, MayHit mayHit, Scan scan)
     {
-        scroll((1 * unitSize()) / 4);
+        const qint64 size = mStore.size();
+        qint64 span = ScanSize;
+
+        if (isForward)
+        {
+            for (qint64 pos = std::max(static_cast<qint64>(0), from); pos < size;)
+            {
+                const qint64 end = std::min(size, pos + span);
+
+                if (!mayHit(pos, end))
+                {
+                    pos = end;
+                    span = std::min(size, 2 * span);
+                }
+                else if ((end - pos) > ScanSize)
+                {
+                    span = (end - pos) / 2;
+                }
+                else
+                {
+                    const qint64 hit = scan(pos, end);
+                    if (hit >= 0) return hit;
+                    pos = end;
+                }
+            }
+        }
+        else
+        {
+            for (qint64 pos = std::min(size - 1, from) + 1; pos > 0;)
+            {
+                const qint64 begin = std::max(static_cast<qint64>(0), pos - span);
+
+                if (!mayHit(begin, pos))
+                {
+                    pos = begin;
+                    span = std::min(size, 2 * span);
+                }
+                else if ((pos - begin) > ScanSize)
+                {
+                    span = (pos - begin) / 2;
+                }
+                else
+                {
+                    const qint64 hit = scan(begin, pos);
+                    if (hit >= 0) return hit;
+                    pos = begin;
+                }
+            }
+        }
+
+        return -1;
     }
 
-    void scroll(double unit)
+    // position of the first (forward) or last hit(k) within [0, size)
+    template <typename Hit>
+    static qint64 scanLanes(qint64 size, bool isForward, Hit hit)
     {
-        mMin += unit;
-        mFocus += unit;
+        const qint64 chunks = (size + Lanes - 1) / Lanes;
+
+        for (qint64 chunk = 0; chunk < chunks; ++chunk)
+        {
+            const qint64 begin = (isForward ? chunk : (chunks - 1 - chunk)) * Lanes;
+            const qint64 end = std::min(size, begin + Lanes);
+            int any = 0;
+            for (qint64 k = begin; k < end; ++k) {any |= hit(k);}
+            if (!any) continue;
+
+            if (isForward)
+            {
+                for (qint64 k = begin; k < end; ++k) {if (hit(k)) return k;}
+            }
+            else
+            {
+                for (qint64 k = end - 1; k >= begin; --k) {if (hit(k)) return k;}
+            }
+        }
+
+        return -1;
     }
+};
 
-    int pixelSize() const
+////////////////////////////////////////////////////////////////////////////////
+// Spectrogram
+////////////////////////////////////////////////////////////////////////////////
+
+// logarithmic intensity maps: blue (low) to red (high)
+static const std::vector<QRgb> & HeatPalette()
+{
+    static const std::vector<QRgb> palette = []()
     {
-        return mPixelSize;
-    }
+        std::vector<QRgb> result(256);
+        for (size_t index = 0; index < result.size(); ++index)
+        {
+            const double level = static_cast<double>(index) / (result.size() - 1);
+            result[index] = QColor::fromHsvF((1.0 - level) * 0.66, 1.0, 1.0).rgb();
+        }
+        return result;
+    }();
 
-    double mmSize() const
+    return palette;
+}
+
+class Fft
+{
+    // Iterative radix-2 FFT. The tables are computed once, transform()
+    // does not modify the object and may run on many threads at once.
+private:
+    const int mSize;
+    std::vector<int> mReverse;
+    std::vector<std::complex<double>> mTwiddle;
+public:
+    explicit Fft(int size):
+        mSize(CeilPow2(size)),
+        mReverse(static_cast<size_t>(mSize), 0),
+        mTwiddle(static_cast<size_t>(mSize / 2))
     {
-        return static_cast<double>(pixelSize()) / mPixelPerMillimeter;
+        int bits = 0;
+        while ((1 << bits) < mSize) {++bits;}
+
+        for (int index = 0; index < mSize; ++index)
+        {
+            for (int bit = 0; bit < bits; ++bit)
+            {
+                if (index & (1 << bit)) {mReverse[index] |= 1 << (bits - 1 - bit);}
+            }
+        }
+
+        for (size_t index = 0; index < mTwiddle.size(); ++index)
+        {
+            mTwiddle[index] = std::polar(1.0, -2 * M_PI * index / mSize);
+        }
     }
 
-    double unitSize() const
+    static int CeilPow2(int size)
     {
-        return mmSize() / mmPerUnit();
+        int result = 1;
+        while (result < size) {result <<= 1;}
+        return result;
     }
 
-    double mmPerUnit() const
+    int size() const
     {
-        return mMillimeterPerUnit * zoomFactor();
+        return mSize;
     }
 
-    double zoomFactor() const
+    // in place, data.size() must be size()
+    void transform(std::vector<std::complex<double>> & data, bool inverse = false) const
     {
-        return ((mZoom < 0) ? (1.0 / (1 << (-mZoom))) : (1 << mZoom));
-    }
+        Q_ASSERT(static_cast<int>(data.size()) == mSize);
 
-    double focus() const {return mFocus;}
-    double min() const {return mMin;}
-    double max() const {return min() + unitSize();}
-    const QString & unit() const {return mUnit;}
+        for (int index = 0; index < mSize; ++index)
+        {
+            if (index < mReverse[index]) {std::swap(data[index], data[mReverse[index]]);}
+        }
+
+        for (int len = 2; len <= mSize; len <<= 1)
+        {
+            const int half = len / 2;
+            const int stride = mSize / len;
+
+            for (int begin = 0; begin < mSize; begin += len)
+            {
+                for (int k = 0; k < half; ++k)
+                {
+                    const std::complex<double> & w = mTwiddle[static_cast<size_t>(k * stride)];
+                    const std::complex<double> odd = data[begin + k + half] * (inverse ? std::conj(w) : w);
+                    data[begin + k + half] = data[begin + k] - odd;
+                    data[begin + k] += odd;
+                }
+            }
+        }
+
+        if (!inverse) return;
+        for (auto & value:data) {value /= mSize;}
+    }
 };
 
-class Translate
+class Spectrogram
 {
-private:
-    const UnitScale & mX;
-    const UnitScale & mY;
-    double mGain;
-    double mSps;
-    Second mDelay;
+    // Short-time Fourier transform of a store as heat map tiles. A column
+    // covers hop samples, a tile TileColumns columns. Every zoom level has
+    // its own power of two hop, tiles are computed on demand and kept in
+    // a small LRU cache. Column power is averaged over up to MaxSegments
+    // Hann windowed FFTs and shown in dB relative to the full scale.
 public:
-    explicit Translate(const UnitScale & x, const UnitScale & y):
-        mX(x),
-        mY(y),
-        mGain(0),
-        mSps(0),
-        mDelay(0)
-    {
-    }
+    enum {DefaultSize = 256, MinSize = 16, MaxSize = 8192};
+    enum {TileColumns = 256, MaxTiles = 512, MaxSegments = 8, RangeDb = 90};
+
+    explicit Spectrogram(const std::shared_ptr<const SampleStore> & store,
+            int fftSize, double fullScale):
+        mStore(store),
+        mFft(std::min(static_cast<int>(MaxSize), std::max(static_cast<int>(MinSize), fftSize))),
+        mWindow(static_cast<size_t>(mFft.size())),
+        mReference(1.0),
+        mMutex(),
+        mTiles(),
+        mOrder(),
+        mIsPrefetching(false)
+    {
+        double sum = 0;
+        for (size_t index = 0; index < mWindow.size(); ++index)
+        {
+            mWindow[index] = 0.5 - 0.5 * std::cos(2 * M_PI * index / mWindow.size());
+            sum += mWindow[index];
+        }
 
-    void debug(const QRect & rect)
-    {
-        int rl = rect.left();
-        int rr = rect.right();
-        int il = xpxToSampleIndex(rl);
-        int ir = xpxToSampleIndex(rr);
-        qDebug() << "Translate px:" << rl << rr
-            << "index:" << il << ir
-            << "time:" << mX.min() << mX.max()
-            << "focus:" << mX.focus() 
-            << "spp:" << samplesPerPixel();
+        // power of a full scale sine in its peak bin
+        const double peak = fullScale * sum / 2;
+        mReference = peak * peak;
     }
 
-    void resetData()
+    int bins() const
     {
-        mGain = 0;
-        mSps = 0;
-        mDelay = 0;
+        return mFft.size() / 2;
     }
 
-    void setData(const DataFile & data)
+    // one column per pixel or less
+    static qint64 hopFor(double samplesPerPixel)
     {
-        mGain = data.gain();
-        mSps = data.sps();
-        mDelay = data.delay();
+        qint64 result = 1;
+        while (result < samplesPerPixel) {result <<= 1;}
+        return result;
     }
 
-    void setGain(double gain)
+    qint64 tileSpan(qint64 hop) const
     {
-        mGain = gain;
+        return hop * TileColumns;
     }
 
-    const UnitScale & X() const
+    qint64 tileCount(qint64 hop) const
     {
-        return mX;
+        return (mStore->size() + tileSpan(hop) - 1) / tileSpan(hop);
     }
 
-    const UnitScale & Y() const
+    // tiles[first, last] of the hop, the missing ones computed in parallel
+    std::vector<QImage> tiles(qint64 hop, qint64 first, qint64 last) const
     {
-        return mY;
+        return render(hop, first, last, true);
     }
 
-    double samplesPerPixel() const
+    // computes tiles[first, last] in the background if no other prefetch runs
+    static void prefetch(const std::shared_ptr<const Spectrogram> & spectrogram,
+            qint64 hop, qint64 first, qint64 last)
     {
-        return mSps / mX.pixelPerUnit();
-    }
+        if (spectrogram->mIsPrefetching.exchange(true)) return;
 
-    int xpxToSampleIndex(int xpx) const
-    {
-        return static_cast<int>((mX.fromPixel(xpx) - mDelay) * mSps);
+        QtConcurrent::run([spectrogram, hop, first, last]()
+        {
+            spectrogram->render(hop, first, last, false);
+            spectrogram->mIsPrefetching = false;
+        });
     }
+private:
+    typedef std::pair<qint64, qint64> Key;
+    struct Entry {QImage image; std::list<Key>::iterator order;};
+
+    const std::shared_ptr<const SampleStore> mStore;
+    const Fft mFft;
+    std::vector<double> mWindow;
+    double mReference;
+    mutable QMutex mMutex;
+    mutable std::map<Key, Entry> mTiles;
+    mutable std::list<Key> mOrder;
+    mutable std::atomic<bool> mIsPrefetching;
+
+    std::vector<QImage> render(qint64 hop, qint64 first, qint64 last, bool parallel) const
+    {
+        first = std::max(static_cast<qint64>(0), first);
+        last = std::min(tileCount(hop) - 1, last);
+
+        // chunks of columns: missing tiles are computed by many threads
+        struct Task {size_t tile; int begin; int end;};
+        std::vector<QImage> result;
+        std::vector<uchar *> bits;
+        std::vector<Task> tasks;
+
+        for (qint64 tile = first; tile <= last; ++tile)
+        {
+            result.push_back(find(Key(hop, tile)));
+            bits.push_back(0);
+            if (!result.back().isNull()) continue;
 
-    int sampleIndexToXpx(double idx) const
-    {
-        return secondToXpx(idx / mSps);
+            result.back() = QImage(TileColumns, bins(), QImage::Format_RGB32);
+            bits.back() = result.back().bits();
+            for (int col = 0; col < TileColumns; col += 32)
+            {
+                tasks.push_back(Task{result.size() - 1, col, col + 32});
+            }
+        }
+
+        if (tasks.empty()) return result;
+        const int stride = result[tasks.front().tile].bytesPerLine();
+
+        auto compute = [&](Task & task)
+        {
+            std::vector<std::complex<double>> buffer;
+            std::vector<double> power;
+            std::vector<int> raw;
+
+            for (int col = task.begin; col < task.end; ++col)
+            {
+                const qint64 column = (first + static_cast<qint64>(task.tile)) * TileColumns + col;
+                spectrum(hop, column, buffer, power, raw);
+                paint(power, bits[task.tile] + col * sizeof(QRgb), stride);
+            }
+        };
+
+        if (parallel)
+        {
+            QtConcurrent::blockingMap(tasks, compute);
+        }
+        else
+        {
+            for (auto & task:tasks) {compute(task);}
+        }
+
+        for (size_t index = 0; index < result.size(); ++index)
+        {
+            if (bits[index]) {insert(Key(hop, first + static_cast<qint64>(index)), result[index]);}
+        }
+
+        return result;
     }
 
-    int secondToXpx(Second sec) const
+    // mean power per bin of column [column * hop, (column + 1) * hop)
+    void spectrum(qint64 hop, qint64 column,
+            std::vector<std::complex<double>> & buffer,
+            std::vector<double> & power,
+            std::vector<int> & raw) const
     {
-        return mX.toPixel(sec + mDelay);
+        const int size = mFft.size();
+        const qint64 begin = column * hop;
+        const int segments = static_cast<int>(std::min(static_cast<qint64>(MaxSegments),
+                    std::max(static_cast<qint64>(1), hop / size)));
+        power.assign(static_cast<size_t>(bins()), 0.0);
+        if (begin >= mStore->size()) return;
+
+        for (int segment = 0; segment < segments; ++segment)
+        {
+            const qint64 center = begin + ((2 * segment + 1) * hop) / (2 * segments);
+            const qint64 first = center - size / 2;
+            mStore->read(first, first + size, raw);
+            if (raw.empty()) continue;
+
+            // no DC: the baseline would dominate the lowest bins
+            double mean = 0;
+            for (auto value:raw) {mean += value;}
+            mean /= raw.size();
+
+            buffer.assign(static_cast<size_t>(size), 0.0);
+            const size_t offset = static_cast<size_t>(std::max(static_cast<qint64>(0), first) - first);
+            for (size_t index = 0; index < raw.size(); ++index)
+            {
+                buffer[offset + index] = (raw[index] - mean) * mWindow[offset + index];
+            }
+
+            mFft.transform(buffer);
+            for (size_t bin = 0; bin < power.size(); ++bin)
+            {
+                power[bin] += std::norm(buffer[bin]) / segments;
+            }
+        }
     }
 
-    double ypxToUnit(int ypx) const
+    // one image column, bin 0 at the bottom
+    void paint(const std::vector<double> & power, uchar * dst, int stride) const
     {
-        return mY.fromPixel(mY.pixelSize() - ypx);
+        const std::vector<QRgb> & palette = HeatPalette();
+        const double scale = (palette.size() - 1) / static_cast<double>(RangeDb);
+        const int rows = static_cast<int>(power.size());
+
+        for (int row = 0; row < rows; ++row)
+        {
+            const double db = 10 * std::log10(power[static_cast<size_t>(rows - 1 - row)] / mReference + 1e-30);
+            const double level = std::min(palette.size() - 1.0, std::max(0.0, (db + RangeDb) * scale));
+            *reinterpret_cast<QRgb *>(dst + row * stride) = palette[static_cast<size_t>(level)];
+        }
     }
-    
-    int unitToYpx(double unit) const
+
+    QImage find(const Key & key) const
     {
-        return static_cast<int>(mY.pixelSize() - mY.toPixel(unit));
+        QMutexLocker lock(&mMutex);
+        auto it = mTiles.find(key);
+        if (it == mTiles.end()) return QImage();
+        mOrder.splice(mOrder.begin(), mOrder, it->second.order);
+        return it->second.image;
     }
-    
-    int lsbToYpx(int lsb) const
+
+    void insert(const Key & key, const QImage & image) const
     {
-        return unitToYpx(mGain * lsb);
+        QMutexLocker lock(&mMutex);
+        if (mTiles.count(key) > 0) return;
+        mOrder.push_front(key);
+        const Entry entry = {image, mOrder.begin()};
+        mTiles.insert(std::make_pair(key, entry));
+
+        while (mOrder.size() > static_cast<size_t>(MaxTiles))
+        {
+            mTiles.erase(mOrder.back());
+            mOrder.pop_back();
+        }
     }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
-// DrawChannel
+// Alignment
 ////////////////////////////////////////////////////////////////////////////////
 
-class DrawChannel
+class Alignment
 {
+    // The lag s maximizing the cross-correlation sum(a[i] * b[i - s]) of
+    // two stores with the same sample rate. Both are decimated to block
+    // means of at most CoarseSize samples and correlated with one complex
+    // FFT, the best coarse lag is then refined at full rate over at most
+    // RefineSize samples. The first differences are correlated, so baseline
+    // wander does not dominate the result.
 public:
-    explicit DrawChannel(QWidget & parent,
-            const QRect & rect,
-            const DataChannel & data,
-            const UnitScale & timeScale,
-            const UnitScale & valueScale);
-private:
-    struct ColorSchema {QColor dark; QColor normal; QColor anno;};
-    void SetColorSchema(size_t index);
-    void DrawDecorations(const DataChannel & chan);
-    void DrawSampleWise(const DataFile & data);
-    void DrawPixelWise(const DataFile & data);
-    void DrawAnnotations(const DataChannel & chan);
-    void DrawRulers();
-    void DrawRange();
+    enum {CoarseSize = 1 << 17, RefineSize = 1 << 17};
 
-    QWidget & mParent;
-    const QRect & mRect;
-    Translate mTranslate;
-    QPainter mPainter;
-    MeasurePerformance mMeasurePerformance;
-    QPen mDefaultPen;
-    ColorSchema mColorSchema;
-};
+    static qint64 lag(const SampleStore & a, const SampleStore & b)
+    {
+        MeasurePerformance measure("Alignment::lag");
+        const qint64 longest = std::max(a.size(), b.size());
+        const qint64 factor = std::max<qint64>(1, (longest + CoarseSize - 1) / CoarseSize);
+        const std::vector<double> coarseA = Decimate(a, factor);
+        const std::vector<double> coarseB = Decimate(b, factor);
+        if (coarseA.empty() || coarseB.empty()) return 0;
+        const qint64 coarse = factor * CoarseLag(coarseA, coarseB);
+        return Refine(a, b, coarse - factor, coarse + factor);
+    }
+private:
+    // first differences of the means of factor samples
+    static std::vector<double> Decimate(const SampleStore & store, qint64 factor)
+    {
+        std::vector<double> result;
+        std::vector<int> samples;
+        double previous = 0;
+        const qint64 step = std::max<qint64>(factor, SampleStore::BlockSize / factor * factor);
 
-////////////////////////////////////////////////////////////////////////////////
+        for (qint64 begin = 0; begin + factor <= store.size(); begin += step)
+        {
+            store.read(begin, std::min(begin + step, store.size() / factor * factor), samples);
 
-struct TimeValueStrings
-{
-    QString time;
-    QString value;
-    enum Mode {Position, Measure} mode;
-};
+            for (size_t first = 0; first + factor <= samples.size(); first += factor)
+            {
+                qint64 sum = 0;
+                for (qint64 index = 0; index < factor; ++index) {sum += samples[first + index];}
+                const double mean = static_cast<double>(sum) / factor;
+                if ((begin > 0) || (first > 0)) {result.push_back(mean - previous);}
+                previous = mean;
+            }
+        }
 
-class GuiMeasure : public QWidget
+        return result;
+    }
+
+    // Both real signals in one transform: z = a + ib, the spectra of a and
+    // b follow from the symmetry of real signals.
+    static qint64 CoarseLag(const std::vector<double> & a, const std::vector<double> & b)
+    {
+        const Fft fft(static_cast<int>(a.size() + b.size()));
+        const int size = fft.size();
+        std::vector<std::complex<double>> z(static_cast<size_t>(size));
+
+        for (size_t index = 0; index < a.size(); ++index) {z[index].real(a[index]);}
+        for (size_t index = 0; index < b.size(); ++index) {z[index].imag(b[index]);}
+        fft.transform(z);
+
+        std::vector<std::complex<double>> c(z.size());
+
+        for (int k = 0; k < size; ++k)
+        {
+            const std::complex<double> mirror = std::conj(z[static_cast<size_t>((size - k) & (size - 1))]);
+            const std::complex<double> spectrumA = 0.5 * (z[k] + mirror);
+            const std::complex<double> spectrumB = std::complex<double>(0, -0.5) * (z[k] - mirror);
+            c[k] = spectrumA * std::conj(spectrumB);
+        }
+
+        fft.transform(c, true);
+
+        // c[s] holds the lag s, c[size + s] the negative lag s
+        const int lastB = static_cast<int>(b.size()) - 1;
+        int best = 0;
+
+        for (int s = -lastB; s < static_cast<int>(a.size()); ++s)
+        {
+            const int index = (s < 0) ? (size + s) : s;
+            const int bestIndex = (best < 0) ? (size + best) : best;
+            if (c[index].real() > c[bestIndex].real()) {best = s;}
+        }
+
+        return best;
+    }
+
+    // the best lag in [lo, hi], over a window valid for all of them
+    static qint64 Refine(const SampleStore & a, const SampleStore & b, qint64 lo, qint64 hi)
+    {
+        qint64 begin = std::max<qint64>(0, hi);
+        qint64 end = std::min(a.size(), b.size() + lo);
+        if (end - begin < 3) return (lo + hi) / 2;
+
+        const qint64 middle = (begin + end) / 2;
+        begin = std::max(begin, middle - RefineSize / 2);
+        end = std::min(end, begin + RefineSize);
+
+        std::vector<int> samplesA;
+        std::vector<int> samplesB;
+        a.read(begin, end, samplesA);
+        b.read(begin - hi, end - lo, samplesB);
+
+        qint64 best = lo;
+        double bestSum = -std::numeric_limits<double>::infinity();
+
+        for (qint64 s = lo; s <= hi; ++s)
+        {
+            const int * pa = samplesA.data();
+            const int * pb = samplesB.data() + (hi - s);
+            double sum = 0;
+
+            for (size_t index = 1; index < samplesA.size(); ++index)
+            {
+                sum += static_cast<double>(pa[index] - pa[index - 1]) * (pb[index] - pb[index - 1]);
+            }
+
+            if (sum > bestSum) {best = s; bestSum = sum;}
+        }
+
+        return best;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// QrsDetector
+////////////////////////////////////////////////////////////////////////////////
+
+class QrsDetector
 {
+    // Streaming beat detection after Pan and Tompkins: band pass 5..15Hz,
+    // derivative, squaring and a 150ms moving window integration. Peaks of
+    // the integrated signal above an adaptive threshold are beats. The R
+    // position is the largest deviation of the raw samples from their mean
+    // shortly before the peak (the filters delay the integrated signal).
 private:
-    Q_OBJECT
-    QPoint mLastPos;
-    TimeValueStrings mTimeValue;
+    enum {Slopes = 5};
+    const Biquad mHighPass;
+    const Biquad mLowPass;
+    const qint64 mWindow;
+    const qint64 mSearch;
+    const qint64 mRefractory;
+    const qint64 mLearning;
+    double mState[4];
+    double mBand[Slopes];
+    std::vector<double> mSquares;
+    std::vector<double> mRaw;
+    size_t mSlot;
+    size_t mRawSlot;
+    double mSum;
+    double mLast[2];
+    qint64 mIndex;
+    double mSignal;
+    double mNoise;
+    double mLearnMax;
+    std::vector<std::pair<qint64, double>> mLearned;
+    qint64 mPending;
+    double mPendingValue;
+    qint64 mLastBeat;
 public:
-    GuiMeasure(QWidget * parent):
-        QWidget(parent)
+    explicit QrsDetector(double sps):
+        mHighPass(Biquad::HighPass, sps, 5, M_SQRT1_2),
+        mLowPass(Biquad::LowPass, sps, 15, M_SQRT1_2),
+        mWindow(std::max(static_cast<qint64>(1), static_cast<qint64>(0.150 * sps))),
+        mSearch(mWindow + mWindow / 2),
+        mRefractory(static_cast<qint64>(0.200 * sps)),
+        mLearning(static_cast<qint64>(2.0 * sps)),
+        mState(),
+        mBand(),
+        mSquares(static_cast<size_t>(mWindow), 0.0),
+        mRaw(static_cast<size_t>(mSearch), 0.0),
+        mSlot(0),
+        mRawSlot(0),
+        mSum(0),
+        mLast(),
+        mIndex(0),
+        mSignal(0),
+        mNoise(0),
+        mLearnMax(0),
+        mLearned(),
+        mPending(-1),
+        mPendingValue(0),
+        mLastBeat(INT_MIN)
+    {
+    }
+
+    // the next samples of the stream, adds the sample index of new beats
+    void feed(const int * samples, qint64 size, std::vector<qint64> & beats)
+    {
+        for (qint64 index = 0; index < size; ++index, ++mIndex)
+        {
+            const double x = samples[index];
+            const double band = mLowPass.step(mHighPass.step(x, mState[0], mState[1]), mState[2], mState[3]);
+            std::copy_backward(mBand, mBand + Slopes - 1, mBand + Slopes);
+            mBand[0] = band;
+
+            // five point derivative, squared and integrated
+            const double slope = (2 * mBand[0] + mBand[1] - mBand[3] - 2 * mBand[4]) / 8;
+            mSum = std::max(0.0, mSum + slope * slope - mSquares[mSlot]);
+            mSquares[mSlot] = slope * slope;
+            mRaw[mRawSlot] = x;
+            const double integrated = mSum / mWindow;
+
+            if ((mLast[0] > mLast[1]) && (mLast[0] >= integrated)) {peak(mLast[0], beats);}
+            mLast[1] = mLast[0];
+            mLast[0] = integrated;
+            if (++mSlot == mSquares.size()) {mSlot = 0;}
+            if (++mRawSlot == mRaw.size()) {mRawSlot = 0;}
+
+            // no later peak can replace the pending beat
+            if ((mPending >= 0) && ((mIndex - mPending) > (mRefractory + mWindow))) {release(beats);}
+        }
+    }
+
+    // end of the stream
+    void finish(std::vector<qint64> & beats)
     {
-        QPalette pal = palette();
-        pal.setBrush(QPalette::Window, QColor(0, 0, 0, 50) );
-        setPalette(pal);
-        setAutoFillBackground(true);
+        if (mLearned.size() > 0) {learned(beats);}
+        if (mPending >= 0) {release(beats);}
+    }
+private:
+    void peak(double value, std::vector<qint64> & beats)
+    {
+        if (mIndex < mLearning)
+        {
+            mLearnMax = std::max(mLearnMax, value);
+            mLearned.push_back(std::make_pair(rPeak(), value));
+            return;
+        }
 
-        setWindowFlags(Qt::SubWindow);
-        QHBoxLayout * layout = new QHBoxLayout(this);
-        layout->setContentsMargins(0, 0, 0, 0);
-        QSizeGrip * grip = new QSizeGrip(this);
-        layout->addWidget(grip, 0, Qt::AlignRight | Qt::AlignBottom);
+        if (mLearned.size() > 0) {learned(beats);}
+        if (isSignal(value)) {beat(rPeak(), value, beats);}
     }
 
-    void deltaMove(int dx, int dy)
+    void learned(std::vector<qint64> & beats)
     {
-        move(x() + dx, y() + dy);
-        emit signalMoved();
+        // thresholds from the first seconds, then their peaks are classified
+        mSignal = mLearnMax / 3;
+        mNoise = mLearnMax / 12;
+        std::vector<std::pair<qint64, double>> peaks;
+        peaks.swap(mLearned);
+
+        for (auto & p:peaks)
+        {
+            if (isSignal(p.second)) {beat(p.first, p.second, beats);}
+        }
     }
 
-    void setTimeValue(const TimeValueStrings & arg)
+    // R: largest deviation from the mean within the search range
+    qint64 rPeak() const
     {
-        mTimeValue = arg;
-        update();
+        const qint64 span = std::min(mSearch, mIndex + 1);
+        auto raw = [&](qint64 back)
+        {
+            const qint64 slot = static_cast<qint64>(mRawSlot) - back;
+            return mRaw[static_cast<size_t>((slot < 0) ? (slot + mSearch) : slot)];
+        };
+
+        double mean = 0;
+        for (qint64 back = 0; back < span; ++back) {mean += raw(back);}
+        mean /= span;
+
+        qint64 result = mIndex;
+        double best = -1;
+        for (qint64 back = 0; back < span; ++back)
+        {
+            const double deviation = std::abs(raw(back) - mean);
+            if (deviation > best) {best = deviation; result = mIndex - back;}
+        }
+
+        return result;
     }
-signals:
-    void signalMoved();
-    void signalResized();
+
+    // adapts the signal and noise levels
+    bool isSignal(double value)
+    {
+        const double threshold = mNoise + 0.25 * (mSignal - mNoise);
+
+        if (value < threshold)
+        {
+            mNoise = 0.125 * value + 0.875 * mNoise;
+            return false;
+        }
+
+        mSignal = 0.125 * value + 0.875 * mSignal;
+        return true;
+    }
+
+    void beat(qint64 r, double value, std::vector<qint64> & beats)
+    {
+        if ((r - mLastBeat) <= mRefractory) return;
+
+        if ((mPending >= 0) && ((r - mPending) <= mRefractory))
+        {
+            // same beat: keep the stronger peak
+            if (value > mPendingValue) {mPending = r; mPendingValue = value;}
+            return;
+        }
+
+        if (mPending >= 0) {release(beats);}
+        mPending = r;
+        mPendingValue = value;
+    }
+
+    void release(std::vector<qint64> & beats)
+    {
+        beats.push_back(mPending);
+        mLastBeat = mPending;
+        mPending = -1;
+    }
+};
+
+class QrsDetection
+{
+    // Beats of a store, detected on a background thread. The GUI thread
+    // takes the annotations found so far while the detection runs.
 private:
-    void mousePressEvent(QMouseEvent *evt) override
+    QMutex mMutex;
+    std::vector<Annotation> mFound;
+    std::atomic<bool> mIsCanceled;
+    std::atomic<bool> mIsDone;
+    QFuture<void> mDone;
+public:
+    QrsDetection():
+        mMutex(),
+        mFound(),
+        mIsCanceled(false),
+        mIsDone(false),
+        mDone()
     {
-        mLastPos = evt->globalPos();
     }
 
-    void mouseMoveEvent(QMouseEvent *evt) override
+    static std::shared_ptr<QrsDetection> start(
+            const std::shared_ptr<const SampleStore> & store, double sps)
+    {
+        std::shared_ptr<QrsDetection> result = std::make_shared<QrsDetection>();
+        result->mDone = QtConcurrent::run([result, store, sps]() {result->run(*store, sps);});
+        return result;
+    }
+
+    void cancel()
+    {
+        mIsCanceled = true;
+    }
+
+    bool isDone() const
+    {
+        return mIsDone;
+    }
+
+    // blocks until the detection is done or canceled
+    void wait()
+    {
+        mDone.waitForFinished();
+    }
+
+    // a cheap check before take()
+    bool hasFound()
+    {
+        QMutexLocker lock(&mMutex);
+        return !mFound.empty();
+    }
+
+    std::vector<Annotation> take()
+    {
+        std::vector<Annotation> result;
+        QMutexLocker lock(&mMutex);
+        result.swap(mFound);
+        return result;
+    }
+
+    void run(const SampleStore & store, double sps)
+    {
+        QrsDetector detector(sps);
+        std::vector<qint64> beats;
+        std::vector<int> samples;
+
+        for (qint64 begin = 0; (begin < store.size()) && !mIsCanceled; begin += SampleStore::BlockSize)
+        {
+            store.read(begin, begin + SampleStore::BlockSize, samples);
+            detector.feed(samples.data(), static_cast<qint64>(samples.size()), beats);
+            publish(beats, sps);
+        }
+
+        detector.finish(beats);
+        publish(beats, sps);
+        mIsDone = true;
+    }
+private:
+    void publish(std::vector<qint64> & beats, double sps)
+    {
+        if (beats.empty()) return;
+        QMutexLocker lock(&mMutex);
+        for (auto beat:beats) {mFound.push_back(Annotation(1000.0 * beat / sps, "R"));}
+        beats.clear();
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// DataFile
+////////////////////////////////////////////////////////////////////////////////
+
+class DataFile
+{
+private:
+    // resampled views of the store, shared by all copies of the file
+    struct ResampleViews
+    {
+        typedef std::tuple<double, Second, qint64> Key;
+        QMutex mutex;
+        std::map<Key, std::shared_ptr<const SampleStore>> stores;
+    };
+
+    std::shared_ptr<const SampleStore> mStore;
+    std::shared_ptr<const SampleStore> mRawStore;
+    std::shared_ptr<ResampleViews> mResampled;
+    std::shared_ptr<const Spectrogram> mSpectrogram;
+    std::shared_ptr<QrsDetection> mQrs;
+    std::vector<Annotation> mAnnotations;
+    Second mDelay;
+    qint64 mRawOffset;
+    double mSps;
+    double mGain;
+    QString mTxt;
+    QString mPath;
+    QString mData;
+    QString mAnno;
+    QString mOper;
+    QString mExpression;
+    QString mUnit;
+    QString mLabel;
+    QString mError;
+    Interleave mInterleave;
+    FilterSetup mFilter;
+    int mLineNumber;
+    int mSpectrogramSize;
+    int mSampleMask;
+    int mSampleOffset;
+    bool mIsSigned;
+    bool mIsBigEndian;
+    bool mIsDensity;
+    bool mIsQrs;
+    bool mIsAutoDelay;
+    ByteOrderMode mByteOrderMode;
+public:
+    DataFile & operator=(const DataFile &) = default;
+    DataFile(const DataFile &) = default;
+    DataFile() = delete;
+    explicit DataFile(const QString & txt, const QString & path = "", int line = -1):
+        mStore(std::make_shared<MemoryStore>(std::vector<int>())),
+        mRawStore(),
+        mResampled(std::make_shared<ResampleViews>()),
+        mSpectrogram(),
+        mQrs(),
+        mAnnotations(),
+        mDelay(0.0),
+        mRawOffset(0),
+        mSps(0.0),
+        mGain(1.0),
+        mTxt(txt),
+        mPath(path),
+        mData(),
+        mAnno(),
+        mOper(),
+        mExpression(),
+        mUnit(),
+        mLabel(),
+        mError(),
+        mInterleave(),
+        mFilter(),
+        mLineNumber(line),
+        mSpectrogramSize(0),
+        mSampleMask(0xffff),
+        mSampleOffset(0),
+        mIsSigned(true),
+        mIsBigEndian(true),
+        mIsDensity(false),
+        mIsQrs(false),
+        mIsAutoDelay(false),
+        mByteOrderMode(GlobalSetup::Instance().byteOrder())
+    {
+        {TraceScope trace("DataFile::parseInfo"); parseInfo();}
+        if (!isExpression() && valid()) {TraceScope trace("DataFile::readData"); readData();}
+        {TraceScope trace("DataFile::readAnno"); readAnno();}
+        debug();
+    }
+
+    int lineNumber() const
+    {
+        return mLineNumber;
+    }
+
+    int sampleMask() const
+    {
+        return mSampleMask;
+    }
+
+    int sampleOffset() const
+    {
+        return mSampleOffset;
+    }
+
+    bool isDensity() const
+    {
+        return mIsDensity;
+    }
+
+    double gain() const
+    {
+        return mGain;
+    }
+
+    double sps() const
+    {
+        return mSps;
+    }
+
+    Second delay() const
+    {
+        return mDelay;
+    }
+
+    Second duration() const
+    {
+        return delay() + static_cast<double>(sampleCount()) / sps();
+    }
+
+    qint64 sampleCount() const
+    {
+        return mStore->size();
+    }
+
+    int lsb(qint64 index) const
+    {
+        return mStore->at(index);
+    }
+
+    // the lsb range of the data file format, samples at either end are clipped
+    int lsbMin() const
+    {
+        const bool isNegative = mIsSigned && (mSampleMask & 0x8000);
+        return (isNegative ? -0x8000 : 0) - mSampleOffset;
+    }
+
+    int lsbMax() const
+    {
+        return (mSampleMask & (mIsSigned ? 0x7fff : 0xffff)) - mSampleOffset;
+    }
+
+    // samples[indexBegin, indexEnd) clipped to the valid range
+    void read(qint64 indexBegin, qint64 indexEnd, std::vector<int> & dst) const
+    {
+        mStore->read(indexBegin, indexEnd, dst);
+    }
+
+    bool isFiltered() const
+    {
+        return mFilter.isUsed();
+    }
+
+    const std::shared_ptr<const SampleStore> & store() const
+    {
+        return mStore;
+    }
+
+    // the decoded samples before filter and operators,
+    // null for expression lines which have no data file
+    const std::shared_ptr<const SampleStore> & rawStore() const
+    {
+        return mRawStore;
+    }
+
+    // index of the raw store = index of the store - rawOffset
+    qint64 rawOffset() const
+    {
+        return mRawOffset;
+    }
+
+    // null unless the info line asks for a spectrogram
+    const std::shared_ptr<const Spectrogram> & spectrogram() const
+    {
+        return mSpectrogram;
+    }
+
+    // null unless the info line asks for beat detection
+    const std::shared_ptr<QrsDetection> & qrs() const
+    {
+        return mQrs;
+    }
+
+    // on the final samples (after all operators of the channel)
+    void startQrs()
+    {
+        if (!mIsQrs || (sampleCount() < 1)) return;
+        if (mQrs) {mQrs->cancel();}
+        mQrs = QrsDetection::start(mStore, mSps);
+    }
+
+    // The samples of this file on another time grid: size samples at sps,
+    // the first one at delay. Views are cached and shared by all users.
+    std::shared_ptr<const SampleStore> resampled(double sps, Second delay, qint64 size) const
+    {
+        if ((sps == mSps) && (delay == mDelay) && (size == sampleCount()))
+        {
+            return mStore;
+        }
+
+        QMutexLocker lock(&mResampled->mutex);
+        std::shared_ptr<const SampleStore> & view = mResampled->stores[
+            ResampleViews::Key(sps, delay, size)];
+
+        if (!view)
+        {
+            view = std::make_shared<ResampleStore>(mStore, mSps, mDelay, sps, delay, size);
+        }
+
+        return view;
+    }
+
+    std::shared_ptr<const SampleStore> resampled(const DataFile & grid) const
+    {
+        return resampled(grid.sps(), grid.delay(), grid.sampleCount());
+    }
+
+    const std::vector<Annotation> & annotations() const
+    {
+        return mAnnotations;
+    }
+
+    bool valid() const
+    {
+        return (error().size() == 0);
+    }
+
+    const QString & error() const
+    {
+        return mError;
+    }
+
+    const QString & txt() const
+    {
+        return mTxt;
+    }
+
+    const QString & unit() const
+    {
+        return mUnit;
+    }
+
+    const QString & label() const
+    {
+        return mLabel;
+    }
+
+    bool isOperator(const QString & arg) const
+    {
+        return (mOper == arg);
+    }
+
+    void minus(const DataFile & other)
+    {
+        // both files on the grid of this file, starting at time 0,
+        // the difference is evaluated per block when needed
+        const qint64 size = static_cast<qint64>(std::ceil(duration() * sps()));
+        const std::vector<std::shared_ptr<const SampleStore>> operands = {
+            resampled(sps(), 0, size), other.resampled(sps(), 0, size)};
+        const std::vector<double> gains = {gain(), other.gain()};
+        setStore(std::make_shared<ExpressionStore>(operands, gains, Expression("a-b"), gain(), size));
+        mRawOffset += std::llround(mDelay * sps());
+        mDelay = 0;
+        mLabel = label() + "-" + other.label();
+    }
+
+    // delay=auto: the delay with the best cross-correlation of this
+    // file and the reference (the first file of the channel)
+    void align(const DataFile & reference)
+    {
+        if (!mIsAutoDelay || (sampleCount() < 1) || (reference.sampleCount() < 1)) return;
+        const qint64 size = static_cast<qint64>(std::ceil(sampleCount() * reference.sps() / sps()));
+        const qint64 lag = Alignment::lag(*reference.store(), *resampled(reference.sps(), mDelay, size));
+        mDelay = reference.delay() + lag / reference.sps();
+        mResampled = std::make_shared<ResampleViews>();
+        debug();
+    }
+
+    bool isExpression() const
+    {
+        return isOperator("=");
+    }
+
+    // The samples of an "=" line: its expression over the latest of the
+    // files (in line order, after their operators) with the operand
+    // labels, on the time grid of the first operand.
+    void evaluate(const std::vector<const DataFile *> & files)
+    {
+        const Expression expression(mExpression);
+        std::vector<std::shared_ptr<const SampleStore>> operands;
+        std::vector<double> gains;
+        const DataFile * grid = nullptr;
+
+        if (!expression.valid())
+        {
+            error(expression.error());
+            return;
+        }
+
+        for (auto & name:expression.names())
+        {
+            auto isOperand = [&name](const DataFile * file) {return file->valid() && (file->label() == name);};
+            auto it = std::find_if(files.rbegin(), files.rend(), isOperand);
+
+            if (it == files.rend())
+            {
+                error("unknown operand: " + name);
+                return;
+            }
+
+            if (!grid) {grid = *it;}
+            operands.push_back((*it)->resampled(*grid));
+            gains.push_back((*it)->gain());
+        }
+
+        if (!grid)
+        {
+            error("expression without operand: " + mExpression);
+            return;
+        }
+
+        mSps = grid->sps();
+        mDelay += grid->delay();
+        mGain = grid->gain();
+        if (mUnit.isEmpty()) {mUnit = grid->unit();}
+        std::shared_ptr<const SampleStore> store = std::make_shared<ExpressionStore>(
+                operands, gains, expression, mGain, grid->sampleCount());
+
+        if (mFilter.isUsed())
+        {
+            store = std::make_shared<FilterStore>(store, mFilter, mSps);
+        }
+
+        setStore(store);
+    }
+
+    qint64 clipIndex(qint64 index) const
+    {
+        const qint64 max = sampleCount() - 1;
+        if (index > max) return max;
+        if (index < 0) return 0;
+        return index;
+    }
+
+    SampleStats lsbStats(qint64 indexBegin, qint64 indexEnd) const
+    {
+        return mStore->stats(indexBegin, indexEnd);
+    }
+
+    struct Stats {double min; double max; double mean; double rms; qint64 count;};
+    Stats stats(qint64 indexBegin, qint64 indexEnd) const
+    {
+        Stats result = {0, 0, 0, 0, 0};
+        const SampleStats lsb = lsbStats(indexBegin, indexEnd);
+        if (lsb.count < 1) return result;
+
+        const double one = gain() * lsb.min;
+        const double two = gain() * lsb.max;
+        result.min = std::min(one, two);
+        result.max = std::max(one, two);
+        result.mean = gain() * lsb.mean();
+        result.rms = std::abs(gain()) * lsb.rms();
+        result.count = lsb.count;
+        return result;
+    }
+
+    struct MinMax {double min; double max;};
+    MinMax minmax(qint64 indexBegin, qint64 indexEnd) const
+    {
+        MinMax result = {0, 0};
+        if (sampleCount() < 1) return result;
+
+        Q_ASSERT(indexBegin <= indexEnd);
+        const qint64 begin = clipIndex(indexBegin);
+        const qint64 end = std::max(begin + 1, clipIndex(indexEnd));
+        const Stats range = stats(begin, end);
+        result.min = range.min;
+        result.max = range.max;
+        return result;
+    }
+
+    // the load steps on their own (Benchmark): the samples of the data
+    // file in its byte order, then the byte order detection on them
+    void decode(std::vector<int> & dst)
+    {
+        readData(dst, mIsBigEndian);
+    }
+
+    void detectByteOrder(std::vector<int> & samples)
+    {
+        autoByteOrder(samples);
+    }
+
+private:
+    void readAnno()
+    {
+        if (mAnno.size() < 1) return;
+        const bool isAbsPath = mAnno.startsWith('/');
+        const QString name = (isAbsPath ? mAnno : (mPath + mAnno));
+        QFile read(name);
+
+        if (!read.open(QIODevice::ReadOnly))
+        {
+            error("anno file missing: " + name);
+            return;
+        }
+
+        QTextStream stream(&read);
+        QRegularExpression re("^\\s*(\\S+)\\s+(.+)\\s*$");
+
+        while (!stream.atEnd())
+        {
+            const QString line = stream.readLine();
+            QRegularExpressionMatch match = re.match(line);
+
+            if (match.hasMatch())
+            {
+                bool valid = true;
+                const Annotation anno(match.captured(1).toDouble(&valid), match.captured(2));
+                if (valid) {mAnnotations.push_back(anno);}
+            }
+            else
+            {
+                qDebug() << "anno error:" << line;
+            }
+        }
+
+        read.close();
+    }
+
+    void debug() const
+    {
+        if (!GlobalSetup::Instance().debug()) return;
+        QTextStream out(stdout);
+        const QString bo = mIsBigEndian
+            ? (mIsSigned ? "bei16" : "beu16")
+            : (mIsSigned ? "lei16" : "leu16");
+        out << mLabel;
+        out << "|" << bo;
+        out << "|mask=0x" << hex << mSampleMask;
+        out << "|offset=0x" << hex << mSampleOffset;
+        out << "|delay=" << dec << mDelay;
+        out << endl;
+    }
+
+    void readData()
+    {
+        if (isPaged())
+        {
+            readPaged();
+            return;
+        }
+
+        std::vector<int> samples;
+        readData(samples, mIsBigEndian);
+        if (mByteOrderMode == AutoByteOrder) autoByteOrder(samples);
+        Trace::Instance().add("samples decoded", static_cast<qint64>(samples.size()));
+        std::shared_ptr<const SampleStore> store = std::make_shared<MemoryStore>(std::move(samples));
+        mRawStore = store;
+
+        if (mFilter.isUsed())
+        {
+            store = std::make_shared<FilterStore>(store, mFilter, mSps);
+        }
+
+        setStore(store);
+    }
+
+    // everything derived from the samples follows the new store
+    void setStore(const std::shared_ptr<const SampleStore> & store)
+    {
+        mStore = store;
+        mResampled = std::make_shared<ResampleViews>();
+        mSpectrogram.reset();
+
+        if (mSpectrogramSize > 0)
+        {
+            const double fullScale = (mSampleMask + 1) / 2.0;
+            mSpectrogram = std::make_shared<Spectrogram>(mStore, mSpectrogramSize, fullScale);
+        }
+    }
+
+    QString dataName() const
+    {
+        const bool isAbsPath = mData.startsWith('/');
+        return (isAbsPath ? (mData) : (mPath + mData));
+    }
+
+    SampleFormat format(bool isBigEndian) const
+    {
+        return SampleFormat{mIsSigned, isBigEndian, mSampleMask, mSampleOffset,
+            mInterleave.blockSize(), mInterleave.channelOffset(), mInterleave.channelSize()};
+    }
+
+    // Decoded files larger than the BlockCache budget are read on demand,
+    // smaller ones are kept in memory.
+    bool isPaged() const
+    {
+        if ((mData == "dummy") || (mData.size() < 1)) return false;
+        const QFileInfo info(dataName());
+        if (!info.exists()) return false;
+        const qint64 decoded = format(mIsBigEndian).sampleCount(info.size() / 2) * static_cast<qint64>(sizeof(int));
+        return (decoded > BlockCache::Instance().budget());
+    }
+
+    void readPaged()
+    {
+        if (mByteOrderMode == AutoByteOrder)
+        {
+            // the start of the file decides the byte order
+            enum {ProbeSize = 1 << 20};
+            std::vector<int> samples;
+            std::vector<int> swap;
+            PagedStore(dataName(), format(mIsBigEndian)).read(0, ProbeSize, samples);
+            PagedStore(dataName(), format(!mIsBigEndian)).read(0, ProbeSize, swap);
+            autoByteOrder(samples, swap);
+        }
+
+        const std::shared_ptr<const PagedStore> paged = std::make_shared<PagedStore>(dataName(), format(mIsBigEndian));
+        PagedStore::index(paged);
+        std::shared_ptr<const SampleStore> store = paged;
+        mRawStore = store;
+
+        if (mFilter.isUsed())
+        {
+            store = std::make_shared<FilterStore>(store, mFilter, mSps);
+        }
+
+        setStore(store);
+    }
+
+    void autoByteOrder(std::vector<int> & samples)
+    {
+        std::vector<int> swap;
+        readData(swap, !mIsBigEndian);
+        autoByteOrder(samples, swap);
+    }
+
+    void autoByteOrder(std::vector<int> & samples, std::vector<int> & swap)
+    {
+        const size_t size = swap.size();
+        Q_ASSERT(samples.size() == size);
+        if (size < 2) return;
+
+        int compare = 0;
+        auto o1 = samples.begin();
+        auto o2 = o1 + 1;
+        auto s1 = swap.begin();
+        auto s2 = s1 + 1;
+
+        // Idea: The difference between 2 samples is usually small (e.g. ECG baseline
+        // sections) but can increase dramatically when assuming the wrong byte order.
+        for (size_t index = 1; index < size; ++index, ++o1, ++o2, ++s1, ++s2)
+        {
+            const int diffOrig = (*o1) - (*o2);
+            const int diffSwap = (*s1) - (*s2);
+            const int cmp = std::abs(diffOrig) - std::abs(diffSwap);
+            if (cmp > 0) ++compare;
+            if (cmp < 0) --compare;
+        }
+
+        if (compare > 0)
+        {
+            qDebug() << "autoByteOrder: swap" << mData;
+            mIsBigEndian = !mIsBigEndian;
+            samples.swap(swap);
+        }
+    }
+
+    void readData(std::vector<int> & dst, bool isBigEndian)
+    {
+        mInterleave.first();
+        dst.clear();
+
+        if (mData == "dummy") return;
+        if (mData.size() < 1) return;
+        const QString name = dataName();
+        QFile read(name);
+
+        if (!read.open(QIODevice::ReadOnly))
+        {
+            error("data file missing: " + name);
+            return;
+        }
+
+        const size_t size = static_cast<size_t>(QFileInfo(name).size());
+        dst.reserve(size / sizeof(qint16));
+        QDataStream stream(&read);
+        stream.setByteOrder(isBigEndian ? QDataStream::BigEndian : QDataStream::LittleEndian);
+
+        while (!stream.atEnd())
+        {
+            int lsb;
+            if (mIsSigned)
+            {
+                const qint16 mask = static_cast<qint16>(mSampleMask);
+                qint16 sample;
+                stream >> sample;
+                lsb = static_cast<int>(sample & mask) - mSampleOffset;
+            }
+            else
+            {
+                const quint16 mask = static_cast<quint16>(mSampleMask);
+                quint16 sample;
+                stream >> sample;
+                lsb = static_cast<int>(sample & mask) - mSampleOffset;
+            }
+
+            if (mInterleave.isUsed())
+            {
+                dst.push_back(lsb);
+            }
+
+            mInterleave.next();
+        }
+
+        read.close();
+    }
+
+    void error(const QString & tag)
+    {
+        QTextStream(&mError) << tag << endl;
+    }
+
+    double toDouble(const QString & src, const QString & tag)
+    {
+        bool done = true;
+        const double result = src.toDouble(&done);
+        if (done) return result;
+        error(tag);
+        return 1;
+    }
+
+    int toInt(int base, const QString & src, const QString & tag)
+    {
+        bool done = true;
+        const int result = src.toInt(&done, base);
+        if (done) return result;
+        error(tag);
+        return 1;
+    }
+
+    void parseInfo()
+    {
+        InfoParser parser(mTxt);
+        mOper = parser.oper();
+        if (isExpression()) {parseExpression(parser); return;}
+        mData = parser.pop();
+        mSps  = toDouble(parser.pop(), "SampleFrequency");
+        double gainDividend = 1.0;
+        const double gainDivisor = toDouble(parser.pop(), "Divider");
+        mUnit = parser.pop();
+        mLabel = parser.unquoted(parser.pop());
+
+        QString dst;
+        if (parser.value(dst, "anno_file")) {mAnno = dst;}
+        if (parser.value(dst, "s-mask"))    {mSampleMask = toInt(16, dst, "s-mask");}
+        if (parser.value(dst, "offset"))    {mSampleOffset = toInt(0, dst, "offset");}
+        if (parser.value(dst, "delay"))     {parseDelay(dst);}
+        if (parser.value(dst, "gain"))      {gainDividend = toDouble(dst, "gain");}
+        parseProcessing(parser);
+
+        mGain = gainDividend / gainDivisor;
+
+        if (mSampleMask == 0x3fff)
+        {
+            // Many info files do not contain any of the u16/i16 keywords. Thus we are
+            // guessing and testing for other typical properties of unsigned ecg samples.
+            mIsSigned = ((mSampleOffset != 0x1fff) && (mSampleOffset != 0x2000));
+        }
+
+        // Hint: Avoid these keywords. They describe only a part of the data.
+        if (parser.tag("swab"))  {mIsBigEndian = !mIsBigEndian;}
+        if (parser.tag("u16"))   {mIsSigned = false;}
+        if (parser.tag("i16"))   {mIsSigned = true;}
+
+        bool keep = false;
+        // Hint: Use these keywords instead: They fully describe the data.
+        if (parser.tag("beu16")) {keep = true; mIsSigned = false; mIsBigEndian = true;}
+        if (parser.tag("leu16")) {keep = true; mIsSigned = false; mIsBigEndian = false;}
+        if (parser.tag("bei16")) {keep = true; mIsSigned = true;  mIsBigEndian = true;}
+        if (parser.tag("lei16")) {keep = true; mIsSigned = true;  mIsBigEndian = false;}
+
+        if (keep)
+        {
+            // neither swapping nor auto-detecting
+            mByteOrderMode = KeepByteOrder;
+        }
+        else if (mByteOrderMode == SwapByteOrder)
+        {
+            mIsBigEndian = !mIsBigEndian;
+        }
+
+        mInterleave.parse(parser.remaining());
+    }
+
+    void parseExpression(InfoParser & parser)
+    {
+        // "= expression unit label keywords", see evaluate()
+        mExpression = parser.unquoted(parser.pop());
+        mUnit = parser.pop();
+        mLabel = parser.unquoted(parser.pop());
+
+        QString dst;
+        if (parser.value(dst, "anno_file")) {mAnno = dst;}
+        if (parser.value(dst, "delay"))     {parseDelay(dst);}
+        parseProcessing(parser);
+        if (mExpression.isEmpty()) {error("expression missing");}
+    }
+
+    // "delay=milliseconds" or "delay=auto", see align()
+    void parseDelay(const QString & src)
+    {
+        mIsAutoDelay = (src == "auto");
+        if (!mIsAutoDelay) {mDelay = toDouble(src, "delay") / 1000.0;}
+    }
+
+    // keywords about processing and display of the samples
+    void parseProcessing(InfoParser & parser)
+    {
+        QString dst;
+
+        // optional filter stage between samples and display
+        if (parser.value(dst, "hp"))        {mFilter.highPass = toDouble(dst, "hp");}
+        if (parser.value(dst, "lp"))        {mFilter.lowPass = toDouble(dst, "lp");}
+        if (parser.value(dst, "notch"))     {mFilter.notch = toDouble(dst, "notch");}
+        if (parser.value(dst, "median"))    {mFilter.median = toDouble(dst, "median");}
+
+        // draw all files of the channel as one intensity map
+        mIsDensity = parser.tag("density");
+
+        // built-in beat detection instead of an anno_file
+        mIsQrs = parser.tag("qrs");
+
+        // time/frequency heat map, optionally with the FFT size
+        if (parser.tag("spectrogram"))
+        {
+            bool isNumber = false;
+            mSpectrogramSize = Spectrogram::DefaultSize;
+            if (parser.value(dst, "spectrogram")) {dst.toInt(&isNumber);}
+            if (isNumber) {mSpectrogramSize = Fft::CeilPow2(std::min(static_cast<int>(Spectrogram::MaxSize), dst.toInt()));}
+
+            // a channel draws only its first file as spectrogram
+            if (isOperator("+") || isOperator("-")) {error("spectrogram on a '" + mOper + "' line");}
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class DataChannel
+////////////////////////////////////////////////////////////////////////////////
+
+class DataChannel
+{
+private:
+    Second mDuration;
+    std::vector<DataFile> mFiles;
+    std::vector<MergedAnnotation> mMergedAnnotations;
+public:
+    void plus(DataFile & file)
+    {
+        if (files().size() > 0) {file.align(files()[0]);}
+        mFiles.push_back(file);
+    }
+
+    void minus(const DataFile & file)
+    {
+        if (files().size() < 1) return;
+        const size_t index = files().size() - 1;
+        DataFile aligned(file);
+        aligned.align(files()[0]);
+        mFiles[index].minus(aligned);
+    }
+
+    void done()
+    {
+        if (files().size() < 1)
+        {
+            mDuration = 0;
+            return;
+        }
+
+        size_t index = 0;
+        mMergedAnnotations.clear();
+        mDuration = files()[0].duration();
+
+        for (auto & file:files())
+        {
+            if (mDuration < file.duration()) {mDuration = file.duration();}
+
+            for (auto & anno:file.annotations())
+            {
+                MergedAnnotation ma{anno, index};
+                ma.annotation.addDelay(file.delay());
+                mMergedAnnotations.push_back(ma);
+            }
+
+            ++index;
+        }
+
+        auto cmp = [](const MergedAnnotation & a, const MergedAnnotation & b)
+        {
+            return a.annotation.sec() < b.annotation.sec();
+        };
+
+        std::sort(mMergedAnnotations.begin(), mMergedAnnotations.end(), cmp);
+        for (auto & file:mFiles) {file.startQrs();}
+    }
+
+    // detected annotations waiting for collect()
+    bool hasDetected() const
+    {
+        for (auto & file:files())
+        {
+            if (file.qrs() && file.qrs()->hasFound()) return true;
+        }
+
+        return false;
+    }
+
+    // Adds the annotations detected since the last call to the merged
+    // list. Returns true if there are any, with their times in first..last.
+    bool collect(Second & first, Second & last)
+    {
+        const size_t before = mMergedAnnotations.size();
+
+        for (size_t index = 0; index < mFiles.size(); ++index)
+        {
+            const DataFile & file = mFiles[index];
+            if (!file.qrs()) continue;
+
+            for (auto & anno:file.qrs()->take())
+            {
+                MergedAnnotation ma{anno, index};
+                ma.annotation.addDelay(file.delay());
+                mMergedAnnotations.push_back(ma);
+            }
+        }
+
+        if (mMergedAnnotations.size() == before) return false;
+
+        auto cmp = [](const MergedAnnotation & a, const MergedAnnotation & b)
+        {
+            return a.annotation.sec() < b.annotation.sec();
+        };
+
+        auto middle = mMergedAnnotations.begin() + before;
+        std::sort(middle, mMergedAnnotations.end(), cmp);
+        first = middle->annotation.sec();
+        last = mMergedAnnotations.back().annotation.sec();
+        std::inplace_merge(mMergedAnnotations.begin(), middle, mMergedAnnotations.end(), cmp);
+        return true;
+    }
+
+    bool isDetecting() const
+    {
+        for (auto & file:files())
+        {
+            if (file.qrs() && !file.qrs()->isDone()) return true;
+        }
+
+        return false;
+    }
+
+    void waitDetecting() const
+    {
+        for (auto & file:files())
+        {
+            if (file.qrs()) {file.qrs()->wait();}
+        }
+    }
+
+    void cancel()
+    {
+        for (auto & file:files())
+        {
+            if (file.qrs()) {file.qrs()->cancel();}
+        }
+    }
+
+    bool isDensity() const
+    {
+        if (GlobalSetup::Instance().density()) return true;
+
+        for (auto & file:files())
+        {
+            if (file.isDensity()) return true;
+        }
+
+        return false;
+    }
+
+    bool isSpectrogram() const
+    {
+        if (files().size() < 1) return false;
+        return (files()[0].spectrogram() != nullptr);
+    }
+
+    bool hasSamples() const
+    {
+        for (auto & file:files())
+        {
+            if (file.sampleCount() > 0) return true;
+        }
+
+        return false;
+    }
+    
+    const std::vector<MergedAnnotation> & mergedAnnotations() const
+    {
+        return mMergedAnnotations;
+    }
+    
+    const std::vector<DataFile> & files() const
+    {
+       return mFiles;
+    }
+
+    QString unit() const
+    {
+        if (files().size() < 1) return "";
+        if (files()[0].sampleCount() < 1) return "";
+        return files()[0].unit();
+    }
+
+    Second duration() const {return mDuration;}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class AnnotationIndex
+////////////////////////////////////////////////////////////////////////////////
+
+class AnnotationIndex
+{
+    // Distinct annotation texts with the times of all occurrences over
+    // all channels. A plain search matches case-insensitive substrings:
+    // the texts containing every 3-gram of the pattern are checked, a
+    // shorter pattern or a regular expression scans the distinct texts.
+    // The matching times of the last search are kept merged and sorted,
+    // finding the next match is a single binary search.
+public:
+    typedef std::vector<Second> Matches;
+    enum {GramSize = 3};
+
+    AnnotationIndex():
+        mTexts(),
+        mLower(),
+        mTimes(),
+        mGrams(),
+        mPattern(),
+        mIsRegex(false),
+        mMatches()
+    {
+    }
+
+    void clear()
+    {
+        mTexts.clear();
+        mLower.clear();
+        mTimes.clear();
+        mGrams.clear();
+        mPattern.clear();
+        mMatches.clear();
+    }
+
+    void add(const QString & txt, Second sec)
+    {
+        auto it = mTexts.find(txt);
+
+        if (it == mTexts.end())
+        {
+            const size_t text = mTimes.size();
+            it = mTexts.insert(txt, text);
+            mLower.push_back(txt.toLower());
+            mTimes.push_back(std::vector<Second>());
+
+            for (int index = 0; index + GramSize <= mLower.back().size(); ++index)
+            {
+                std::vector<size_t> & texts = mGrams[mLower.back().mid(index, GramSize)];
+                if (texts.empty() || (texts.back() != text)) {texts.push_back(text);}
+            }
+        }
+
+        mTimes[it.value()].push_back(sec);
+    }
+
+    void done()
+    {
+        mPattern.clear();
+        mMatches.clear();
+    }
+
+    // the sorted times of all texts containing the pattern, or matching
+    // it as regular expression, valid until the next find()
+    const Matches & find(const QString & pattern, bool isRegex) const
+    {
+        if ((pattern == mPattern) && (isRegex == mIsRegex)) return mMatches;
+        mPattern = pattern;
+        mIsRegex = isRegex;
+        mMatches.clear();
+        if (pattern.size() < 1) return mMatches;
+
+        if (isRegex)
+        {
+            const QRegularExpression re(pattern, QRegularExpression::CaseInsensitiveOption);
+            if (!re.isValid()) return mMatches;
+
+            for (auto it = mTexts.begin(); it != mTexts.end(); ++it)
+            {
+                if (re.match(it.key()).hasMatch()) {append(it.value());}
+            }
+        }
+        else
+        {
+            const QString lower = pattern.toLower();
+
+            for (auto text:candidates(lower))
+            {
+                if (mLower[text].contains(lower)) {append(text);}
+            }
+        }
+
+        std::sort(mMatches.begin(), mMatches.end());
+        return mMatches;
+    }
+
+    static qint64 count(const Matches & matches)
+    {
+        return static_cast<qint64>(matches.size());
+    }
+
+    // first match at or after sec
+    static bool first(const Matches & matches, Second sec, Second & dst)
+    {
+        auto it = std::lower_bound(matches.begin(), matches.end(), sec);
+        if (it == matches.end()) return false;
+        dst = *it;
+        return true;
+    }
+
+    // first match after sec
+    static bool next(const Matches & matches, Second sec, Second & dst)
+    {
+        auto it = std::upper_bound(matches.begin(), matches.end(), sec);
+        if (it == matches.end()) return false;
+        dst = *it;
+        return true;
+    }
+
+    // last match before sec
+    static bool previous(const Matches & matches, Second sec, Second & dst)
+    {
+        auto it = std::lower_bound(matches.begin(), matches.end(), sec);
+        if (it == matches.begin()) return false;
+        dst = *(--it);
+        return true;
+    }
+private:
+    QHash<QString, size_t> mTexts;
+    std::vector<QString> mLower;
+    std::vector<std::vector<Second>> mTimes;
+    QHash<QString, std::vector<size_t>> mGrams;
+    mutable QString mPattern;
+    mutable bool mIsRegex;
+    mutable Matches mMatches;
+
+    void append(size_t text) const
+    {
+        mMatches.insert(mMatches.end(), mTimes[text].begin(), mTimes[text].end());
+    }
+
+    // the texts with every 3-gram of the lowercase pattern, all texts
+    // for shorter patterns
+    std::vector<size_t> candidates(const QString & lower) const
+    {
+        std::vector<size_t> result;
+
+        if (lower.size() < GramSize)
+        {
+            for (size_t text = 0; text < mLower.size(); ++text) {result.push_back(text);}
+            return result;
+        }
+
+        for (int index = 0; index + GramSize <= lower.size(); ++index)
+        {
+            auto it = mGrams.find(lower.mid(index, GramSize));
+            if (it == mGrams.end()) return std::vector<size_t>();
+
+            if (index == 0)
+            {
+                result = it.value();
+                continue;
+            }
+
+            std::vector<size_t> both;
+            std::set_intersection(result.begin(), result.end(), it.value().begin(), it.value().end(), std::back_inserter(both));
+            result.swap(both);
+            if (result.empty()) break;
+        }
+
+        return result;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class DataMain
+////////////////////////////////////////////////////////////////////////////////
+
+class DataMain
+{
+private:
+    std::vector<DataChannel> mChannels;
+    mutable AnnotationIndex mIndex;
+    mutable bool mIsIndexDirty;
+    Second mDuration;
+    QString mError;
+public:
+    explicit DataMain(const QString & infoName):
+        mChannels(),
+        mIndex(),
+        mIsIndexDirty(true),
+        mDuration(0),
+        mError()
+    {
+        MeasurePerformance measure("DataMain::ctor");
+        QFile info(infoName);
+
+        if (!info.open(QIODevice::ReadOnly))
+        {
+            error("info file missing: " + infoName);
+            return;
+        }
+
+        const QString path = QFileInfo(info).path() + "/";
+        QTextStream in(&info);
+        std::vector<DataFile> fileList;
+        int lineNumber = 0;
+
+        while (!in.atEnd())
+        {
+            const QString line = in.readLine();
+            ++lineNumber;
+
+            if (QRegularExpression("^#").match(line).hasMatch())
+            {
+                // ignore "comment" lines
+                continue;
+            }
+
+            if (!QRegularExpression("\\S").match(line).hasMatch())
+            {
+                // ignore "whitespace only" lines
+                continue;
+            }
+
+            const DataFile file(line, path, lineNumber);
+            fileList.push_back(file);
+        }
+        
+        for (size_t index = 0; index < fileList.size(); ++index)
+        {
+            DataFile & file = fileList[index];
+
+            if (file.valid() && file.isExpression())
+            {
+                // the files so far as the channels hold them, e.g. with
+                // the labels of "-" lines
+                std::vector<const DataFile *> files;
+                for (auto & chan:mChannels) {for (auto & done:chan.files()) {files.push_back(&done);}}
+                file.evaluate(files);
+            }
+
+            if (!file.valid())
+            {
+                QString txt;
+                QTextStream(&txt) << "line " << file.lineNumber() << ": " << file.txt();
+                error(txt);
+                error(file.error());
+                continue;
+            }
+                
+            if (file.isOperator(">")) create(file);
+            if (file.isOperator("=")) create(file);
+            if (file.isOperator("+")) plus(file);
+            if (file.isOperator("-")) minus(file);
+        }
+
+        mDuration = 0;
+        
+        for (auto & chan:mChannels)
+        {
+            chan.done();
+            if (mDuration < chan.duration()) {mDuration = chan.duration();}
+        }
+    }
+    
+    ~DataMain()
+    {
+        for (auto & chan:mChannels) {chan.cancel();}
+    }
+
+    bool valid() const {return error().size() == 0;}
+    Second duration() const {return mDuration;}
+    const QString & error() const {return mError;}
+
+    // the annotations a channel collected, in first..last
+    struct Collected {size_t channel; Second first; Second last;};
+
+    // the channels with detected annotations waiting for collect()
+    std::vector<size_t> detected() const
+    {
+        std::vector<size_t> result;
+
+        for (size_t index = 0; index < mChannels.size(); ++index)
+        {
+            if (mChannels[index].hasDetected()) {result.push_back(index);}
+        }
+
+        return result;
+    }
+
+    std::vector<Collected> collect(const std::vector<size_t> & channels)
+    {
+        std::vector<Collected> result;
+
+        for (auto index:channels)
+        {
+            Collected collected{index, 0, 0};
+            if (mChannels[index].collect(collected.first, collected.last)) {result.push_back(collected);}
+        }
+
+        mIsIndexDirty |= !result.empty();
+        return result;
+    }
+
+    // built on first use after loading or collecting annotations
+    const AnnotationIndex & annotationIndex() const
+    {
+        if (mIsIndexDirty)
+        {
+            MeasurePerformance measure("DataMain::annotationIndex");
+            mIndex.clear();
+
+            for (auto & chan:mChannels)
+            {
+                for (auto & merged:chan.mergedAnnotations())
+                {
+                    mIndex.add(merged.annotation.txt(), merged.annotation.sec());
+                }
+            }
+
+            mIndex.done();
+            mIsIndexDirty = false;
+        }
+
+        return mIndex;
+    }
+
+    bool isDetecting() const
+    {
+        for (auto & chan:mChannels)
+        {
+            if (chan.isDetecting()) return true;
+        }
+
+        return false;
+    }
+
+    // headless: all annotations before the output
+    void finishDetecting()
+    {
+        std::vector<size_t> channels;
+
+        for (size_t index = 0; index < mChannels.size(); ++index)
+        {
+            mChannels[index].waitDetecting();
+            channels.push_back(index);
+        }
+
+        collect(channels);
+    }
+
+    const std::vector<DataChannel> & channels() const
+    {
+       return mChannels;
+    }
+private:
+    void error(const QString & add)
+    {
+        QTextStream(&mError) << add << endl;
+    }
+
+    void create(DataFile & file)
+    {
+        DataChannel data;
+        mChannels.push_back(data);
+        plus(file);
+    }
+
+    void plus(DataFile & file)
+    {
+        if (channels().size() < 1) return;
+        const size_t index = channels().size() - 1;
+        mChannels[index].plus(file);
+    }
+
+    void minus(DataFile & file)
+    {
+        if (channels().size() < 1) return;
+        const size_t index = channels().size() - 1;
+        mChannels[index].minus(file);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// UnitScale
+////////////////////////////////////////////////////////////////////////////////
+
+class UnitScale
+{
+private:
+    const QString mUnit;
+    const double mMillimeterPerUnit;
+    double mPixelPerMillimeter;
+    double mMinData;
+    double mMaxData;
+    double mMin;
+    double mFocus;
+    int mPixelSize;
+    int mZoom;
+public:
+    explicit UnitScale(double speed, const QString & unit):
+        mUnit(unit),
+        mMillimeterPerUnit(speed),
+        mPixelPerMillimeter(0),
+        mMinData(0),
+        mMaxData(0),
+        mMin(0),
+        mFocus(0),
+        mPixelSize(0),
+        mZoom(0)
+    {
+    }
+
+    void setYResolution()
+    {
+        const QDesktopWidget desk;
+        setPixelPerMillimeter(desk.height(), desk.heightMM());
+    }
+
+    void setXResolution()
+    {
+        const QDesktopWidget desk;
+        setPixelPerMillimeter(desk.width(), desk.widthMM());
+    }
+
+    void setPixelPerMillimeter(double px, double mm)
+    {
+        mPixelPerMillimeter = px / mm;
+    }
+
+    void setPixelSize(int px)
+    {
+        qDebug() << "UnitScale::setPixelSize" << mPixelSize << "->" << px;
+        mPixelSize = px;
+        updateAutoZoom();
+    }
+
+    void setFocus(double unit)
+    {
+        qDebug() << "UnitScale::setFocus" << unit << "min:" << min() << "max:" << max();
+        mFocus = unit;
+    }
+
+    void setFocusPixel(int px)
+    {
+        setFocus(fromPixel(px));
+    }
+
+    double millimeterToPixel(double mm) const
+    {
+        return mPixelPerMillimeter * mm;
+    }
+
+    double pixelPerUnit() const
+    {
+        return mPixelPerMillimeter * mmPerUnit();
+    }
+
+    int toPixel(double unit) const
+    {
+        double result = (unit - min()) * pixelPerUnit();
+        result += (result > 0) ? 0.5 : -0.5;
+        return static_cast<int>(result);
+    }
+
+    double pixelToUnit(int px) const
+    {
+        return px / pixelPerUnit();
+    }
+
+    double fromPixel(int px) const
+    {
+        return min() + pixelToUnit(px);
+    }
+
+    // exactly [min, max] over the pixel size, whatever the resolution
+    // (headless rendering, see Snapshot)
+    void fit(double min, double max)
+    {
+        mPixelPerMillimeter = pixelSize() / ((max - min) * mMillimeterPerUnit);
+        mMinData = min;
+        mMaxData = max;
+        mZoom = 0;
+        mMin = min;
+        mFocus = (min + max) / 2;
+    }
+
+    void autoZoom(double min, double max)
+    {
+        qDebug() << "UnitScale::autoZoom" << min << max;
+        mMinData = min;
+        mMaxData = max;
+        updateAutoZoom();
+    }
+private:
+    void updateAutoZoom()
+    {
+        const double range = mMaxData - mMinData;
+        const double offset = (mMaxData + mMinData) / 2;
+        mZoom = 0;
+        if ((range > 0) && (pixelSize() > 0))
+        {
+            while (range < unitSize()) {zoomIn();}
+            while (range > unitSize()) {zoomOut();}
+        }
+        mMin = offset - unitSize() / 2;
+        mFocus = (min() + max()) / 2;
+    }
+public:
+    void zoomIn()
+    {
+        ++mZoom;
+        mMin += (mFocus - min()) / 2;
+        qDebug() << "UnitScale::zoomIn" << mZoom;
+    }
+
+    void zoomOut()
+    {
+        --mZoom;
+        mMin -= (mFocus - min());
+        qDebug() << "UnitScale::zoomOut" << mZoom;
+    }
+
+    int scrollLeft()
+    {
+        return scrollPixel((-1 * pixelSize()) / 4);
+    }
+
+    int scrollRight()
+    {
+        return scrollPixel((1 * pixelSize()) / 4);
+    }
+
+    int scrollPixel(int px)
+    {
+        // whole pixels only: the caller can reuse the shifted image
+        scroll(pixelToUnit(px));
+        return px;
+    }
+
+    void scroll(double unit)
+    {
+        mMin += unit;
+        mFocus += unit;
+    }
+
+    int pixelSize() const
+    {
+        return mPixelSize;
+    }
+
+    double mmSize() const
+    {
+        return static_cast<double>(pixelSize()) / mPixelPerMillimeter;
+    }
+
+    double unitSize() const
+    {
+        return mmSize() / mmPerUnit();
+    }
+
+    double mmPerUnit() const
+    {
+        return mMillimeterPerUnit * zoomFactor();
+    }
+
+    double zoomFactor() const
+    {
+        return ((mZoom < 0) ? (1.0 / (1 << (-mZoom))) : (1 << mZoom));
+    }
+
+    // same pixels for the same data
+    bool isSameView(const UnitScale & other) const
+    {
+        return (mMin == other.mMin) && (mZoom == other.mZoom) && (mPixelSize == other.mPixelSize);
+    }
+
+    double focus() const {return mFocus;}
+    double min() const {return mMin;}
+    double max() const {return min() + unitSize();}
+    const QString & unit() const {return mUnit;}
+};
+
+class Translate
+{
+private:
+    const UnitScale & mX;
+    const UnitScale & mY;
+    double mGain;
+    double mSps;
+    Second mDelay;
+public:
+    explicit Translate(const UnitScale & x, const UnitScale & y):
+        mX(x),
+        mY(y),
+        mGain(0),
+        mSps(0),
+        mDelay(0)
+    {
+    }
+
+    void debug(const QRect & rect)
+    {
+        int rl = rect.left();
+        int rr = rect.right();
+        qint64 il = xpxToSampleIndex(rl);
+        qint64 ir = xpxToSampleIndex(rr);
+        qDebug() << "Translate px:" << rl << rr
+            << "index:" << il << ir
+            << "time:" << mX.min() << mX.max()
+            << "focus:" << mX.focus() 
+            << "spp:" << samplesPerPixel();
+    }
+
+    void resetData()
+    {
+        mGain = 0;
+        mSps = 0;
+        mDelay = 0;
+    }
+
+    void setData(const DataFile & data)
+    {
+        mGain = data.gain();
+        mSps = data.sps();
+        mDelay = data.delay();
+    }
+
+    void setGain(double gain)
+    {
+        mGain = gain;
+    }
+
+    const UnitScale & X() const
+    {
+        return mX;
+    }
+
+    const UnitScale & Y() const
+    {
+        return mY;
+    }
+
+    double samplesPerPixel() const
+    {
+        return mSps / mX.pixelPerUnit();
+    }
+
+    double xpxToSamplePos(int xpx) const
+    {
+        return (mX.fromPixel(xpx) - mDelay) * mSps;
+    }
+
+    qint64 xpxToSampleIndex(int xpx) const
+    {
+        return static_cast<qint64>((mX.fromPixel(xpx) - mDelay) * mSps);
+    }
+
+    int sampleIndexToXpx(double idx) const
+    {
+        return secondToXpx(idx / mSps);
+    }
+
+    int secondToXpx(Second sec) const
+    {
+        return mX.toPixel(sec + mDelay);
+    }
+
+    double ypxToUnit(int ypx) const
+    {
+        return mY.fromPixel(mY.pixelSize() - ypx);
+    }
+    
+    int unitToYpx(double unit) const
+    {
+        return static_cast<int>(mY.pixelSize() - mY.toPixel(unit));
+    }
+    
+    int lsbToYpx(int lsb) const
+    {
+        return unitToYpx(mGain * lsb);
+    }
+};
+
+// the values of all files of the channel within the view of the time
+// scale, for UnitScale::autoZoom (GuiWave::yzoomAuto and Snapshot)
+static DataFile::MinMax VisibleRange(const DataChannel & chan, const UnitScale & time, const UnitScale & value)
+{
+    DataFile::MinMax result = {0, 0};
+    bool first = true;
+
+    for (auto & data:chan.files())
+    {
+        Translate t(time, value);
+        t.setData(data);
+        const DataFile::MinMax mm = data.minmax(t.xpxToSampleIndex(0), t.xpxToSampleIndex(time.pixelSize()));
+        result.min = first ? mm.min : std::min(result.min, mm.min);
+        result.max = first ? mm.max : std::max(result.max, mm.max);
+        first = false;
+    }
+
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// DrawChannel
+////////////////////////////////////////////////////////////////////////////////
+
+class DrawChannel
+{
+public:
+    // Interactive: no antialiasing, coarser pixel columns (see mPixelStep)
+    // Full: antialiased, one pixel column per min/max line
+    enum Quality {Interactive, Full};
+
+    explicit DrawChannel(QImage & image,
+            const QFont & font,
+            const QRect & rect,
+            const DataChannel & data,
+            const UnitScale & timeScale,
+            const UnitScale & valueScale,
+            Quality quality = Full,
+            int pixelStep = 1);
+
+    // what the drawing touched, for traces and the HUD of GuiWave
+    struct Counts
+    {
+        qint64 samples;
+        qint64 primitives;
+        qint64 annotations;
+        double samplesPerPixel;
+        QString path;
+
+        Counts():
+            samples(0),
+            primitives(0),
+            annotations(0),
+            samplesPerPixel(0),
+            path()
+        {
+        }
+
+        void add(const Counts & other)
+        {
+            samples += other.samples;
+            primitives += other.primitives;
+            annotations += other.annotations;
+            samplesPerPixel = other.samplesPerPixel;
+            path = other.path;
+        }
+    };
+
+    const Counts & counts() const {return mCounts;}
+
+    // the summaries a pixel column reads: raw samples up to the leaves of
+    // RangeStats, a level of it or the summaries of whole blocks
+    static QString PixelWisePath(double samplesPerPixel);
+
+    // Area covered by labels, rulers and range texts. These stay at a
+    // fixed widget position and must be redrawn when the waves scroll.
+    static QRegion FixedRegion(const QWidget & parent,
+            const DataChannel & data,
+            const UnitScale & timeScale,
+            const UnitScale & valueScale);
+
+    // Labels stack from a multiple of the view width one or two widths
+    // left of the view: scrolling keeps the layout until the view crosses
+    // such a multiple.
+    static Second LabelStart(const UnitScale & timeScale);
+private:
+    struct ColorSchema {QColor dark; QColor normal; QColor anno;};
+    struct RangeTexts {QString top; QString bottom;};
+    static RangeTexts RangeText(const DataChannel & chan, const Translate & translate, int height);
+    void SetColorSchema(size_t index);
+    void DrawDecorations(const DataChannel & chan);
+    void DrawSampleWise(const DataFile & data);
+    void DrawFiles(const DataChannel & chan);
+    void DrawDensity(const DataChannel & chan);
+    void DrawPixelWise(const DataFile & data);
+    void DrawSpectrogram(const DataFile & data);
+    void DrawAnnotations(const DataChannel & chan);
+    void DrawRulers();
+    void DrawRange(const DataChannel & chan);
+
+    const QSize mSize;
+    const QRect & mRect;
+    Translate mTranslate;
+    QPainter mPainter;
+    MeasurePerformance mMeasurePerformance;
+    QPen mDefaultPen;
+    ColorSchema mColorSchema;
+    Quality mQuality;
+    int mPixelStep;
+    Counts mCounts;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct TimeValueStrings
+{
+    QString time;
+    QString value;
+    enum Mode {Position, Measure} mode;
+};
+
+class GuiMeasure : public QWidget
+{
+private:
+    Q_OBJECT
+    QPoint mLastPos;
+    TimeValueStrings mTimeValue;
+public:
+    GuiMeasure(QWidget * parent):
+        QWidget(parent)
+    {
+        QPalette pal = palette();
+        pal.setBrush(QPalette::Window, QColor(0, 0, 0, 50) );
+        setPalette(pal);
+        setAutoFillBackground(true);
+
+        setWindowFlags(Qt::SubWindow);
+        QHBoxLayout * layout = new QHBoxLayout(this);
+        layout->setContentsMargins(0, 0, 0, 0);
+        QSizeGrip * grip = new QSizeGrip(this);
+        layout->addWidget(grip, 0, Qt::AlignRight | Qt::AlignBottom);
+    }
+
+    void deltaMove(int dx, int dy)
+    {
+        move(x() + dx, y() + dy);
+        emit signalMoved();
+    }
+
+    void setTimeValue(const TimeValueStrings & arg)
+    {
+        mTimeValue = arg;
+        update();
+    }
+signals:
+    void signalMoved();
+    void signalDragged();
+    void signalResized();
+private:
+    void mousePressEvent(QMouseEvent *evt) override
+    {
+        mLastPos = evt->globalPos();
+    }
+
+    void mouseMoveEvent(QMouseEvent *evt) override
+    {
+        const QPoint delta = evt->globalPos() - mLastPos;
+        move(x()+delta.x(), y()+delta.y());
+        mLastPos = evt->globalPos();
+        emit signalDragged();
+    }
+
+    void mouseReleaseEvent(QMouseEvent *) override
+    {
+        emit signalMoved();
+    }
+
+    void resizeEvent(QResizeEvent *) override
+    {
+        emit signalResized();
+    }
+
+    void paintEvent(QPaintEvent *) override
+    {
+        QPainter painter(this);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+
+        const QPen black(Qt::black, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+        const int y1 = painter.fontMetrics().ascent();
+        const int y2 = height() - 2;
+        painter.setPen(black);
+        painter.drawText(2, y1, mTimeValue.time);
+        painter.drawText(2, y2, mTimeValue.value);
+
+        const int w = width();
+        const int h = height();
+        const QPen red(Qt::red, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+        painter.setPen(red);
+
+        const bool isMeasure = (mTimeValue.mode == TimeValueStrings::Measure);
+        if (isMeasure)
+        {
+            // draw red box to signal measure mode
+            painter.drawRect(1, 1, w-2, h-2);
+        }
+        else
+        {
+            // draw red crosshairs to mark the focus point
+            const int x = w / 2;
+            const int y = h / 2;
+            painter.drawLine(0, y, w, y);
+            painter.drawLine(x, 0, x, h);
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+class ArgumentParser
+{
+public:
+    ArgumentParser();
+    void ParseList(QStringList list);
+    void PrintUsage();
+    bool IsInvalid() const {return mIsInvalid;}
+    bool IsUnitTest() const {return mIsUnitTest;}
+    bool IsDrawPoints() const {return mDrawPoints;}
+    bool IsShowHelp() const {return mIsShowHelp;}
+    int CacheMb() const {return mCacheMb;}
+    int RowHeight() const {return mRowHeight;}
+    const QStringList & Files() const {return mFiles;}
+
+    // headless snapshots (--png), an empty range is the whole recording
+    struct Range {double begin; double end;};
+    bool IsPng() const {return !mPng.isEmpty();}
+    const QString & Png() const {return mPng;}
+    const std::vector<Range> & Ranges() const {return mRanges;}
+    const QSize & Size() const {return mSize;}
+    const std::vector<int> & Channels() const {return mChannels;}
+
+    // streaming export (--export)
+    bool IsExport() const {return !mExport.isEmpty();}
+    bool IsStats() const {return mIsStats;}
+
+    // benchmarks (--bench) and synthetic data (--generate)
+    struct Synthetic
+    {
+        int seconds;
+        int leads;
+        int sps;
+        int annosPerMinute;
+        bool isInterleaved;
+        bool isLittleEndian;
+    };
+
+    bool IsBench() const {return mIsBench;}
+    const QString & Generate() const {return mGenerate;}
+    const Synthetic & Generator() const {return mSynthetic;}
+
+    // render benchmark (--render-bench)
+    const QString & Golden() const {return mGolden;}
+    bool IsUpdateGolden() const {return mIsUpdateGolden;}
+    double Tolerance() const {return mTolerance;}
+
+    // Chrome trace JSON (--trace)
+    const QString & TraceFile() const {return mTraceFile;}
+    const QString & ExportFormat() const {return mExport;}
+    const QString & Output() const {return mOutput;}
+private:
+    void ParseLine(const QString & file);
+    bool mIsInvalid;
+    bool mIsUnitTest;
+    bool mDrawPoints;
+    bool mIsShowHelp;
+    int mCacheMb;
+    int mRowHeight;
+    QString mPng;
+    std::vector<Range> mRanges;
+    QSize mSize;
+    std::vector<int> mChannels;
+    QString mExport;
+    bool mIsStats;
+    bool mIsBench;
+    QString mGenerate;
+    Synthetic mSynthetic;
+    QString mGolden;
+    bool mIsUpdateGolden;
+    double mTolerance;
+    QString mTraceFile;
+    QString mOutput;
+    QString mApplication;
+    QStringList mFiles;
+};
+    
+////////////////////////////////////////////////////////////////////////////////
+
+static QString FormatTime(double seconds)
+{
+    int64_t us = static_cast<int64_t>(std::round(std::abs(1e6 * seconds)));
+    int64_t ms = us / 1e3;
+    us -= ms * 1e3;
+    auto msstr = [](int64_t mst, int64_t ust) {
+        return QString("%1.%2ms").arg(mst).arg(ust, 3, 10, QChar('0'));
+    };
+
+    if (GlobalSetup::Instance().displayMilliSeconds())
+    {
+        return msstr(ms, us);
+    }
+
+    int64_t factor = 1000 * 60 * 60;
+    const int64_t hour = ms / factor;
+    ms -= hour * factor;
+    factor /= 60;
+    const int64_t min = ms / factor;
+    ms -= min * factor;
+    factor /= 60;
+    const int64_t sec = ms / factor;
+    ms -= sec * factor;
+        
+    QString result;
+    QTextStream s(&result);
+    if (seconds < 0) s << "-";
+    if (hour != 0) s << hour << "h";
+    if ( min != 0) s << min  << "m";
+    if ( sec != 0) s << sec  << "s";
+    s << msstr(ms, us);
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class DrawChannel
+////////////////////////////////////////////////////////////////////////////////
+    
+DrawChannel::DrawChannel(QImage & image,
+            const QFont & font,
+            const QRect & rect,
+            const DataChannel & chan,
+            const UnitScale & timeScale,
+            const UnitScale & valueScale,
+            Quality quality,
+            int pixelStep):
+    mSize(image.size() / image.devicePixelRatio()),
+    mRect(rect),
+    mTranslate(timeScale, valueScale),
+    mPainter(&image),
+    mMeasurePerformance("DrawChannel"),
+    mDefaultPen(Qt::magenta, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin),
+    mColorSchema(),
+    mQuality(quality),
+    mPixelStep((quality == Full) ? 1 : std::max(1, pixelStep)),
+    mCounts()
+{
+    mPainter.setRenderHint(QPainter::Antialiasing, mQuality == Full);
+    mPainter.setFont(font);
+    mPainter.setClipRect(mRect);
+    mPainter.fillRect(mRect, Qt::white);
+    if (chan.isSpectrogram()) {DrawSpectrogram(chan.files()[0]);}
+    DrawAnnotations(chan);
+
+    if (chan.isDensity())
+    {
+        DrawDensity(chan);
+    }
+    else
+    {
+        DrawFiles(chan);
+    }
+
+    mTranslate.resetData();
+    DrawDecorations(chan);
+    DrawRulers();
+    DrawRange(chan);
+
+    Trace & trace = Trace::Instance();
+    trace.counter("samples drawn", mCounts.samples);
+    trace.counter("primitives drawn", mCounts.primitives);
+    trace.counter("cache hits", BlockCache::Instance().hits());
+    trace.counter("cache misses", BlockCache::Instance().misses());
+}
+
+QRegion DrawChannel::FixedRegion(const QWidget & parent,
+            const DataChannel & chan,
+            const UnitScale & timeScale,
+            const UnitScale & valueScale)
+{
+    // mirrors the geometry of DrawDecorations, DrawRange and DrawRulers
+    const QFontMetrics fm = parent.fontMetrics();
+    const int step = fm.height();
+    const int w = parent.width();
+    const int h = parent.height();
+    QRegion result;
+
+    int labelWidth = 0;
+    for (auto & data:chan.files())
+    {
+        labelWidth = std::max(labelWidth, fm.width(data.label()));
+    }
+
+    const int labelBottom = (static_cast<int>(chan.files().size()) + 1) * step + fm.descent();
+    result += QRect(0, 0, 20 + labelWidth + 1, labelBottom + 1);
+
+    const Translate t(timeScale, valueScale);
+    const RangeTexts range = RangeText(chan, t, h);
+    result += QRect(0, 0, fm.width(range.top) + 1, step);
+    result += QRect(0, h - fm.ascent(), fm.width(range.bottom) + 1, step);
+
+    const int x1 = w - 10;
+    const int y1 = h - 10;
+    const int x2 = x1 - timeScale.millimeterToPixel(25);
+    const int y2 = y1 - valueScale.millimeterToPixel(10);
+    const QString xt = FormatTime(25 / timeScale.mmPerUnit());
+    result += QRect(QPoint(x2 - 3, y2 - 3), QPoint(w, h));
+    result += QRect(x2 + 3, y1 - 3 - fm.ascent(), fm.width(xt) + 1, step);
+    return result;
+}
+
+Second DrawChannel::LabelStart(const UnitScale & timeScale)
+{
+    const Second width = timeScale.unitSize();
+    if (!(width > 0)) return timeScale.min();
+    return (std::floor(timeScale.min() / width) - 1) * width;
+}
+
+void DrawChannel::DrawFiles(const DataChannel & chan)
+{
+    size_t dataIndex = 0;
+    for (auto & data:chan.files())
+    {
+        SetColorSchema(dataIndex++);
+        mTranslate.setData(data);
+        //mTranslate.debug(mRect);
+
+        if (data.spectrogram()) continue;
+        if (data.sampleCount() > 1)
+        {
+            // while interacting we prefer the cheaper min/max columns
+            const double spp = (mQuality == Full) ? 5 : 1;
+            const bool isPixelWise = mTranslate.samplesPerPixel() > spp;
+            mCounts.samplesPerPixel = mTranslate.samplesPerPixel();
+
+            if (isPixelWise)
+            {
+                mCounts.path = PixelWisePath(mCounts.samplesPerPixel);
+                DrawPixelWise(data);
+            }
+            else
+            {
+                mCounts.path = (mTranslate.samplesPerPixel() < 0.5) ? "sample-wise points" : "sample-wise";
+                DrawSampleWise(data);
+            }
+        }
+    }
+}
+
+QString DrawChannel::PixelWisePath(double samplesPerPixel)
+{
+    const int shift = static_cast<int>(std::floor(std::log2(std::max(1.0, samplesPerPixel))));
+    const int leaf = static_cast<int>(std::log2(RangeStats().blockSize()));
+    if (shift < leaf) return "pixel-wise raw";
+    if (shift >= SampleStore::BlockShift) return "pixel-wise blocks";
+    return QString("pixel-wise level %1").arg(shift - leaf);
+}
+
+void DrawChannel::DrawDensity(const DataChannel & chan)
+{
+    // Hit count per pixel over all files of the channel. Columns do not
+    // share any pixel, so chunks of columns are accumulated in parallel.
+    mCounts.path = "density";
+    const QRect area = mRect.intersected(QRect(QPoint(0, 0), mSize));
+    if (area.isEmpty()) return;
+    const int w = area.width();
+    const int h = area.height();
+    std::vector<quint32> hits(static_cast<size_t>(w) * h, 0);
+
+    struct Columns {int begin; int end;};
+    std::vector<Columns> chunks;
+    for (int x = 0; x < w; x += 64) {chunks.push_back(Columns{x, std::min(w, x + 64)});}
+
+    auto accumulate = [&](Columns & columns)
+    {
+        Translate t(mTranslate.X(), mTranslate.Y());
+
+        for (auto & data:chan.files())
+        {
+            const qint64 size = data.sampleCount();
+            if ((size < 2) || data.spectrogram()) continue;
+            t.setData(data);
+
+            // linear interpolation between neighbouring samples
+            auto value = [&](double pos)
+            {
+                const qint64 index = std::min(size - 2, static_cast<qint64>(pos));
+                const double fraction = pos - index;
+                const int one = data.lsb(index);
+                const int two = data.lsb(index + 1);
+                return one + fraction * (two - one);
+            };
+
+            for (int col = columns.begin; col < columns.end; ++col)
+            {
+                const int xpx = area.left() + col;
+                const double posLeft = t.xpxToSamplePos(xpx);
+                const double posRight = t.xpxToSamplePos(xpx + 1);
+                if ((posRight < 0) || (posLeft > (size - 1))) continue;
+
+                const double a = std::max(0.0, posLeft);
+                const double b = std::min(size - 1.0, posRight);
+                double lo = std::min(value(a), value(b));
+                double hi = std::max(value(a), value(b));
+                const qint64 first = static_cast<qint64>(std::ceil(a));
+                const qint64 last = static_cast<qint64>(std::floor(b));
+
+                if (first <= last)
+                {
+                    const SampleStats range = data.lsbStats(first, last + 1);
+                    lo = std::min(lo, static_cast<double>(range.min));
+                    hi = std::max(hi, static_cast<double>(range.max));
+                }
+
+                const int y1 = t.lsbToYpx(static_cast<int>(std::floor(lo)));
+                const int y2 = t.lsbToYpx(static_cast<int>(std::ceil(hi)));
+                const int top = std::max(area.top(), std::min(y1, y2));
+                const int bottom = std::min(area.bottom(), std::max(y1, y2));
+                quint32 * hit = &hits[static_cast<size_t>(top - area.top()) * w + col];
+
+                for (int y = top; y <= bottom; ++y, hit += w)
+                {
+                    ++(*hit);
+                }
+            }
+        }
+    };
+
+    QtConcurrent::blockingMap(chunks, accumulate);
+
+    // Every file hits a pixel at most once, so the scale is the number of
+    // files: the same for every rect, strips repainted after scrolling
+    // match their neighbours.
+    quint32 peak = 0;
+    for (auto & data:chan.files()) {peak += ((data.sampleCount() >= 2) && !data.spectrogram()) ? 1 : 0;}
+    if (peak < 1) return;
+
+    // logarithmic intensity: blue (rare) to red (frequent)
+    const std::vector<QRgb> & palette = HeatPalette();
+    const double scale = (palette.size() - 1) / std::log(1.0 + peak);
+    QImage image(w, h, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    for (int y = 0; y < h; ++y)
+    {
+        QRgb * line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        const quint32 * hit = &hits[static_cast<size_t>(y) * w];
+
+        for (int x = 0; x < w; ++x)
+        {
+            if (hit[x] < 1) continue;
+            line[x] = palette[static_cast<size_t>(std::log(1.0 + hit[x]) * scale)];
+        }
+    }
+
+    mPainter.drawImage(area.topLeft(), image);
+}
+
+void DrawChannel::DrawSpectrogram(const DataFile & data)
+{
+    // Tiles of the zoom level covering the request, stretched to the
+    // full height. Neighbouring tiles are likely needed next.
+    mCounts.path = "spectrogram";
+    const std::shared_ptr<const Spectrogram> & spectrogram = data.spectrogram();
+    if (data.sampleCount() < 1) return;
+    mTranslate.setData(data);
+
+    const qint64 hop = Spectrogram::hopFor(mTranslate.samplesPerPixel());
+    const double span = static_cast<double>(spectrogram->tileSpan(hop));
+    const qint64 count = spectrogram->tileCount(hop);
+    const qint64 first = std::max(static_cast<qint64>(0), static_cast<qint64>(
+                std::floor(mTranslate.xpxToSamplePos(mRect.left()) / span)));
+    const qint64 last = std::min(count - 1, static_cast<qint64>(
+                std::floor(mTranslate.xpxToSamplePos(mRect.right() + 1) / span)));
+
+    if (first <= last)
+    {
+        const std::vector<QImage> tiles = spectrogram->tiles(hop, first, last);
+        mPainter.setRenderHint(QPainter::SmoothPixmapTransform, mQuality == Full);
+
+        for (qint64 tile = first; tile <= last; ++tile)
+        {
+            const int left = mTranslate.sampleIndexToXpx(tile * span);
+            const int right = mTranslate.sampleIndexToXpx((tile + 1) * span);
+            const QRect target(left, 0, right - left, mSize.height());
+            mPainter.drawImage(target, tiles[static_cast<size_t>(tile - first)]);
+        }
+
+        Spectrogram::prefetch(spectrogram, hop, first - 1, last + 1);
+    }
+
+    mTranslate.resetData();
+}
+
+void DrawChannel::DrawDecorations(const DataChannel & chan)
+{
+    const int x = 20;
+    const int step = mPainter.fontMetrics().height();
+    int y = 2 * step;
+
+    size_t dataIndex = 0;
+    for (auto & data:chan.files())
+    {
+        SetColorSchema(dataIndex++);
+        mPainter.setPen(mDefaultPen);
+        mPainter.drawText(QPoint(x, y), data.label());
+        y += step;
+    }
+}
+
+DrawChannel::RangeTexts DrawChannel::RangeText(const DataChannel & chan,
+            const Translate & translate, int height)
+{
+    RangeTexts result;
+
+    if (chan.isSpectrogram())
+    {
+        // frequency axis of the heat map
+        result.top = QString::number(chan.files()[0].sps() / 2) + "Hz";
+        result.bottom = "0Hz";
+        return result;
+    }
+
+    const QString unit = translate.Y().unit();
+    result.top = QString::number(translate.ypxToUnit(0)) + unit;
+    result.bottom = QString::number(translate.ypxToUnit(height)) + unit;
+    return result;
+}
+
+void DrawChannel::DrawRange(const DataChannel & chan)
+{
+    const QPen rulerPen(Qt::black, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+    mPainter.setPen(rulerPen);
+    const int pxmax = 0;
+    const int pxmin = mSize.height();
+    const int as = mPainter.fontMetrics().ascent();
+    const RangeTexts range = RangeText(chan, mTranslate, pxmin);
+    mPainter.drawText(QPoint(0, pxmax + as), range.top);
+    mPainter.drawText(QPoint(0, pxmin), range.bottom);
+}
+
+void DrawChannel::DrawRulers()
+{
+    const QPen rulerPen(Qt::black, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+    mPainter.setPen(rulerPen);
+    const UnitScale & xs = mTranslate.X();
+    const UnitScale & ys = mTranslate.Y();
+    const double xmm = 25;
+    const double ymm = 10;
+    const int x1 = mSize.width() - 10;
+    const int y1 = mSize.height() - 10;
+    const int x2 = x1 - xs.millimeterToPixel(xmm);
+    const int y2 = y1 - ys.millimeterToPixel(ymm);
+    mPainter.drawLine(QPoint(x1, y1), QPoint(x2, y1));
+    mPainter.drawLine(QPoint(x1, y1), QPoint(x1, y2));
+    mPainter.drawLine(QPoint(x2, (y1 - 3)), QPoint(x2, (y1 + 3)));
+    mPainter.drawLine(QPoint((x1 - 3), y2), QPoint((x1 + 3), y2));
+    
+    const double xu = xmm / xs.mmPerUnit();
+    const double yu = ymm / ys.mmPerUnit();
+    const QString xt = FormatTime(xu);
+    const QString yt = QString::number(yu) + ys.unit();
+    const auto fm = mPainter.fontMetrics();
+    const QRect yb = fm.boundingRect(yt);
+    mPainter.drawText(QPoint((x1 - yb.width() - 3), (y2 + fm.ascent())), yt);
+    mPainter.drawText(QPoint((x2 + 3), y1 - 3), xt);
+}
+
+void DrawChannel::DrawAnnotations(const DataChannel & chan)
+{
+    TraceScope trace("DrawChannel::DrawAnnotations");
+    const int flags = Qt::TextSingleLine|Qt::TextDontClip;
+    const int requestLeft = mRect.left();
+    const int requestRight = mRect.right();
+    const int max = INT_MAX;
+    QRect lastBounds(INT_MIN, 0, 0, 0);
+    const int bottom = mSize.height() - 1;
+    int annosPerPixel = 0;
+    int annosLaidOut = 0;
+
+    // Long recordings have many annotations (e.g. detected beats): start
+    // left of the view, far enough for the layout. Neither the start nor
+    // the thinning depend on the request or the exact view, so strips
+    // repainted after a scroll stack the labels as a full repaint does.
+    const std::vector<MergedAnnotation> & annotations = chan.mergedAnnotations();
+    const Second start = LabelStart(mTranslate.X());
+    auto isBefore = [](const MergedAnnotation & merged, Second sec) {return merged.annotation.sec() < sec;};
+    auto first = std::lower_bound(annotations.begin(), annotations.end(), start, isBefore);
+
+    for (auto it = first; it != annotations.end(); ++it)
+    {
+        const MergedAnnotation & merged = *it;
+        SetColorSchema(merged.fileIndex);
+        const QPen annoPen(mColorSchema.anno, 1, Qt::DotLine, Qt::RoundCap, Qt::RoundJoin);
+        mPainter.setPen(annoPen);
+
+        auto & anno = merged.annotation;
+        const int textLeft = mTranslate.secondToXpx(anno.sec());
+        if (textLeft > requestRight) return;
+        QRect bounds(textLeft, lastBounds.top(), max, max);
+        bounds = mPainter.boundingRect(bounds, flags, anno.txt());
+        const bool isOverlapping = bounds.left() < lastBounds.right();
+
+        if (isOverlapping)
+        {
+            bounds.moveTop(lastBounds.bottom());
+
+            if (bounds.bottom() > mSize.height())
+            {
+                bounds.moveTop(0);
+            }
+        }
+        else
+        {
+            bounds.moveTop(0);
+        }
+
+        if (lastBounds.x() == bounds.x())
+        {
+            ++annosPerPixel;
+        }
+        else
+        {
+            annosPerPixel = 0;
+        }
+
+        lastBounds = bounds;
+        if ((annosPerPixel > 1) && (annosLaidOut > 1000)) continue;
+        ++annosLaidOut;
+        if (bounds.right() < requestLeft) continue;
+        mPainter.drawText(bounds.bottomLeft(), anno.txt());
+        mPainter.drawLine(bounds.bottomLeft(), QPoint(bounds.left(), bottom));
+        mCounts.primitives += 2;
+        ++mCounts.annotations;
+    }
+}
+
+void DrawChannel::DrawPixelWise(const DataFile & data)
+{
+    TraceScope trace("DrawChannel::DrawPixelWise");
+    mPainter.setPen(mDefaultPen);
+    const int step = mPixelStep;
+    const qint64 indexEnd = data.sampleCount() - 1;
+    const int xpxBegin = mRect.left() - (mRect.left() % step);
+    const int xpxEnd = mRect.right() + 2;
+        
+    for (int xpx = xpxBegin; xpx < xpxEnd; xpx += step)
+    {
+        qint64 indexFirst = mTranslate.xpxToSampleIndex(xpx);
+        if (indexFirst < 0) indexFirst = 0;
+        if (indexFirst > indexEnd) return;
+
+        qint64 indexLast = mTranslate.xpxToSampleIndex(xpx + step);
+        if (indexLast > indexEnd) indexLast = indexEnd;
+        if (indexLast < 0) continue;
+
+        // 1st line per column:
+        // - from last sample in previous column
+        // - to first sample in current column
+        auto first = mTranslate.lsbToYpx(data.lsb(indexFirst));
+        auto last = mTranslate.lsbToYpx(data.lsb(std::max<qint64>(0, indexFirst - 1)));
+        mPainter.drawLine(xpx - step, last, xpx, first);
+
+        // 2nd line per column:
+        // - from min sample in current column
+        // - to max sample in current column
+        const SampleStats range = data.lsbStats(indexFirst, std::max(indexFirst + 1, indexLast));
+        auto min = mTranslate.lsbToYpx(range.min);
+        auto max = mTranslate.lsbToYpx(range.max);
+        mCounts.samples += range.count;
+        mCounts.primitives += 2;
+
+        if (step == 1)
+        {
+            mPainter.drawLine(xpx, min, xpx, max);
+        }
+        else
+        {
+            // coarse column: one filled bar covers all pixels of the step
+            const QRect bar(QPoint(xpx, min), QPoint(xpx + step - 1, max));
+            mPainter.fillRect(bar.normalized(), mDefaultPen.color());
+        }
+    }
+}
+
+void DrawChannel::DrawSampleWise(const DataFile & data)
+{
+    TraceScope trace("DrawChannel::DrawSampleWise");
+    const qint64 indexLeft = mTranslate.xpxToSampleIndex(mRect.left() - 1) - 1;
+    const qint64 indexRight = mTranslate.xpxToSampleIndex(mRect.right() + 1) + 1;
+    const qint64 indexBegin = data.clipIndex(indexLeft);
+    const qint64 indexEnd = data.clipIndex(indexRight);
+    if ((indexEnd - indexBegin) < 1) return;
+
+    QPen linePen = mDefaultPen;
+    const QPen pointPen(mColorSchema.dark, 3, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+    const bool drawPoints = mTranslate.samplesPerPixel() < 0.5;
+    auto indexNow = indexBegin;
+    std::vector<int> samples;
+    data.read(indexBegin, indexEnd + 1, samples);
+    mCounts.samples += static_cast<qint64>(samples.size());
+    mCounts.primitives += (indexEnd - indexBegin) * (drawPoints ? 2 : 1);
+    auto now  = samples.begin();
+    auto end  = samples.begin() + (indexEnd - indexBegin);
+    auto yold = mTranslate.lsbToYpx(*now);
+    auto xold = mTranslate.sampleIndexToXpx(indexNow);
+    ++now;
+    ++indexNow;
+
+    if (drawPoints)
+    {
+        linePen.setColor(mColorSchema.normal);
+        mPainter.setPen(pointPen);
+        mPainter.drawPoint(xold, yold);
+    }
+
+    while (now <= end)
+    {
+        auto ynow = mTranslate.lsbToYpx(*now);
+        auto xnow = mTranslate.sampleIndexToXpx(indexNow);
+        ++now;
+        ++indexNow;
+        mPainter.setPen(linePen);
+        mPainter.drawLine(xold, yold, xnow, ynow);
+        xold = xnow;
+        yold = ynow;
+
+        if (drawPoints)
+        {
+            mPainter.setPen(pointPen);
+            mPainter.drawPoint(xnow, ynow);
+        }
+    }
+}
+
+void DrawChannel::SetColorSchema(size_t index)
+{
+    static const std::vector<ColorSchema> schema = {
+        {Qt::black,     Qt::gray,  Qt::lightGray},
+        {Qt::darkGreen, Qt::green, Qt::green},
+        {Qt::darkRed,   Qt::red,   Qt::red},
+        {Qt::darkBlue,  Qt::blue,  Qt::blue},
+    };
+
+    if (index >= schema.size()) {index = 0;}
+    mColorSchema = schema[index];
+    mDefaultPen.setColor(mColorSchema.dark);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class ArgumentParser
+////////////////////////////////////////////////////////////////////////////////
+
+ArgumentParser::ArgumentParser():
+    mIsInvalid(false),
+    mIsUnitTest(false),
+    mDrawPoints(false),
+    mIsShowHelp(false),
+    mCacheMb(0),
+    mRowHeight(0),
+    mPng(),
+    mRanges(),
+    mSize(1600, 900),
+    mChannels(),
+    mExport(),
+    mIsStats(false),
+    mIsBench(false),
+    mGenerate(),
+    mSynthetic(Synthetic{3600, 12, 500, 60, false, false}),
+    mGolden(),
+    mIsUpdateGolden(false),
+    mTolerance(0),
+    mTraceFile(),
+    mOutput(),
+    mFiles()
+{
+}
+
+void ArgumentParser::ParseList(QStringList list)
+{
+    if (list.size() > 0)
+    {
+        mApplication = list[0];
+    }
+
+    for (int index = 1; index < list.size(); ++index)
+    {
+        ParseLine(list[index]);
+    }
+}
+
+void ArgumentParser::ParseLine(const QString & line)
+{
+    if ((line == QString("-t")) || (line == QString("--test")))
+    {
+        mIsUnitTest = true;
+        return;
+    }
+
+    if ((line == QString("-p")) || (line == QString("--points")))
+    {
+        mDrawPoints = true;
+        return;
+    }
+
+    if ((line == QString("-h")) || (line == QString("--help")))
+    {
+        mIsShowHelp = true;
+        return;
+    }
+
+    const QRegExp cacheOption("--cache-mb=(\\d+)");
+
+    if (cacheOption.exactMatch(line))
+    {
+        mCacheMb = cacheOption.cap(1).toInt();
+        mIsInvalid = (mCacheMb < 1);
+        return;
+    }
+
+    const QRegExp rowOption("--row-height=(\\d+)");
+
+    if (rowOption.exactMatch(line))
+    {
+        mRowHeight = rowOption.cap(1).toInt();
+        mIsInvalid = (mRowHeight < 1);
+        return;
+    }
+
+    const QRegExp traceOption("--trace=(.+)");
+
+    if (traceOption.exactMatch(line))
+    {
+        mTraceFile = traceOption.cap(1);
+        return;
+    }
+
+    const QRegExp pngOption("--png=(.+)");
+
+    if (pngOption.exactMatch(line))
+    {
+        mPng = pngOption.cap(1);
+        return;
+    }
+
+    const QRegExp exportOption("--export=(csv|f32|i16)");
+
+    if (exportOption.exactMatch(line))
+    {
+        mExport = exportOption.cap(1);
+        return;
+    }
+
+    if (line == QString("--stats"))
+    {
+        mIsStats = true;
+        return;
+    }
+
+    if (line == QString("--bench"))
+    {
+        mIsBench = true;
+        return;
+    }
+
+    const QRegExp generateOption("--generate=(.+)");
+
+    if (generateOption.exactMatch(line))
+    {
+        mGenerate = generateOption.cap(1);
+        return;
+    }
+
+    if (line == QString("--interleave"))
+    {
+        mSynthetic.isInterleaved = true;
+        return;
+    }
+
+    if (line == QString("--little-endian"))
+    {
+        mSynthetic.isLittleEndian = true;
+        return;
+    }
+
+    const QRegExp syntheticOption("--(seconds|leads|sps|annos-per-min)=(\\d+)");
+
+    if (syntheticOption.exactMatch(line))
+    {
+        const int value = syntheticOption.cap(2).toInt();
+        if (syntheticOption.cap(1) == "seconds") {mSynthetic.seconds = value;}
+        if (syntheticOption.cap(1) == "leads") {mSynthetic.leads = value;}
+        if (syntheticOption.cap(1) == "sps") {mSynthetic.sps = value;}
+        if (syntheticOption.cap(1) == "annos-per-min") {mSynthetic.annosPerMinute = value;}
+        mIsInvalid = (value < 1) && (syntheticOption.cap(1) != "annos-per-min");
+        return;
+    }
+
+    const QRegExp goldenOption("--render-bench=(.+)");
+
+    if (goldenOption.exactMatch(line))
+    {
+        mGolden = goldenOption.cap(1);
+        return;
+    }
+
+    if (line == QString("--update-golden"))
+    {
+        mIsUpdateGolden = true;
+        return;
+    }
+
+    const QRegExp toleranceOption("--tolerance=([.\\d]+)");
+
+    if (toleranceOption.exactMatch(line))
+    {
+        bool isNumber = false;
+        mTolerance = toleranceOption.cap(1).toDouble(&isNumber);
+        mIsInvalid = !isNumber;
+        return;
+    }
+
+    const QRegExp outputOption("--output=(.+)");
+
+    if (outputOption.exactMatch(line))
+    {
+        mOutput = outputOption.cap(1);
+        return;
+    }
+
+    const QRegExp rangeOption("--range=(.+)");
+
+    if (rangeOption.exactMatch(line))
+    {
+        // begin:end in seconds, more of them separated by ","
+        const QRegExp range("([-+.\\d]+):([-+.\\d]+)");
+
+        for (auto & txt:rangeOption.cap(1).split(','))
+        {
+            bool isBegin = false;
+            bool isEnd = false;
+            if (range.exactMatch(txt)) {mRanges.push_back(Range{range.cap(1).toDouble(&isBegin), range.cap(2).toDouble(&isEnd)});}
+            if (!isBegin || !isEnd || (mRanges.back().end <= mRanges.back().begin)) {mIsInvalid = true; return;}
+        }
+
+        return;
+    }
+
+    const QRegExp sizeOption("--size=(\\d+)x(\\d+)");
+
+    if (sizeOption.exactMatch(line))
+    {
+        mSize = QSize(sizeOption.cap(1).toInt(), sizeOption.cap(2).toInt());
+        mIsInvalid = mSize.isEmpty();
+        return;
+    }
+
+    const QRegExp channelsOption("--channels=([\\d,]+)");
+
+    if (channelsOption.exactMatch(line))
+    {
+        for (auto & txt:channelsOption.cap(1).split(',', QString::SkipEmptyParts))
+        {
+            mChannels.push_back(txt.toInt());
+        }
+
+        return;
+    }
+
+    const QRegExp longOption("--(\\w+)");
+
+    if (longOption.exactMatch(line))
+    {
+        std::cout << "Unknown option: " << longOption.cap(0).toStdString() << std::endl;
+        mIsInvalid = true;
+        return;
+    }
+
+    const QRegExp shortOption("-(\\w)");
+
+    if (shortOption.exactMatch(line))
+    {
+        std::cout << "Unknown option: " << shortOption.cap(0).toStdString() << std::endl;
+        mIsInvalid = true;
+        return;
+    }
+
+    // assume filename argument
+    mFiles.push_back(line);
+}
+
+void ArgumentParser::PrintUsage()
+{
+    std::stringstream ss;
+    ss << "Usage:" << std::endl;
+    ss << "  " << mApplication.toStdString() << " [options] [file]" << std::endl;
+    ss << "Options:" << std::endl;
+    ss << "  -t --test   ... execute unit tests" << std::endl;
+    ss << "  -h --help   ... show this help" << std::endl;
+    ss << "  --cache-mb=N ... memory for decoded samples (default 512)," << std::endl;
+    ss << "                   larger data files are paged from disk" << std::endl;
+    ss << "  --row-height=N ... minimum channel height in pixels (default 120)," << std::endl;
+    ss << "                     more channels scroll (PageUp/PageDown, +/-)" << std::endl;
+    ss << "  --trace=FILE ... Chrome trace JSON of spans and counters, written" << std::endl;
+    ss << "                   on exit (or environment NO_TRACE=FILE)" << std::endl;
+    ss << "Headless:" << std::endl;
+    ss << "  " << mApplication.toStdString() << " --png=DIR [options] info-file..." << std::endl;
+    ss << "  --png=DIR ... render every info file to DIR/NAME.png, no window" << std::endl;
+    ss << "  --range=BEGIN:END[,BEGIN:END...] ... seconds, one image each" << std::endl;
+    ss << "                                     (DIR/NAME_BEGIN-ENDs.png)" << std::endl;
+    ss << "  --size=WxH ... image size (default 1600x900)" << std::endl;
+    ss << "  --channels=I,J,... ... channels from 0 (default all)" << std::endl;
+    ss << "Export:" << std::endl;
+    ss << "  " << mApplication.toStdString() << " --export=csv|f32|i16 [options] info-file" << std::endl;
+    ss << "  --export=csv ... time and values of every file of the channels" << std::endl;
+    ss << "  --export=f32 ... values as little endian float32 frames" << std::endl;
+    ss << "  --export=i16 ... lsb as little endian int16 frames" << std::endl;
+    ss << "  --output=FILE ... instead of stdout" << std::endl;
+    ss << "  --range=BEGIN:END --channels=I,J,... ... as above, first range only" << std::endl;
+    ss << "Report:" << std::endl;
+    ss << "  " << mApplication.toStdString() << " --stats [--output=FILE] [--channels=I,J,...] info-file..." << std::endl;
+    ss << "  --stats ... JSON statistics of every file, whole and between annotations" << std::endl;
+    ss << "Benchmarks:" << std::endl;
+    ss << "  " << mApplication.toStdString() << " --bench [info-file] ... load and decode benchmarks," << std::endl;
+    ss << "                          of synthetic data without info file" << std::endl;
+    ss << "  " << mApplication.toStdString() << " --generate=DIR ... synthetic DIR/bench.info with data and annotations" << std::endl;
+    ss << "  --seconds=N --leads=N --sps=N --annos-per-min=N ... (default 3600 12 500 60)" << std::endl;
+    ss << "  --interleave ... all leads in one data file" << std::endl;
+    ss << "  --little-endian ... instead of big endian samples" << std::endl;
+    ss << "  " << mApplication.toStdString() << " --render-bench=DIR [--size=WxH] ... DrawChannel frame times," << std::endl;
+    ss << "                          images compared with DIR/*.png, missing ones fail" << std::endl;
+    ss << "  --update-golden ... write the images to DIR instead" << std::endl;
+    ss << "  --tolerance=P ... percent of pixels allowed to differ (default 0)" << std::endl;
+    std::cout << ss.str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class Headless
+////////////////////////////////////////////////////////////////////////////////
+
+class Headless
+{
+    // parts shared by the modes without window (Snapshot, Export, Report)
+public:
+    // --channels=I,J,...: all channels without any
+    static bool IsSelected(const std::vector<int> & channels, size_t index)
+    {
+        return channels.empty() || (std::find(channels.begin(), channels.end(), static_cast<int>(index)) != channels.end());
+    }
+
+    // An own pool for the info files: beat detections and parallel
+    // drawing or scanning run on the global one while the files wait.
+    static QThreadPool & Pool()
+    {
+        static QThreadPool & pool = Trace::Instance().newPool(QThread::idealThreadCount());
+        return pool;
+    }
+
+    // --output=FILE or stdout, an empty string or the error
+    static QString Open(QFile & out, const QString & name)
+    {
+        const bool isOpen = name.isEmpty()
+            ? out.open(stdout, QIODevice::WriteOnly)
+            : out.open(QIODevice::WriteOnly);
+        return isOpen ? QString() : ("cannot write " + (name.isEmpty() ? QString("stdout") : name));
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class Snapshot
+////////////////////////////////////////////////////////////////////////////////
+
+class Snapshot
+{
+    // Headless rendering of info files to PNG through DrawChannel, one
+    // row per channel. Every info file is loaded once for all of its
+    // ranges, the info files are rendered in parallel.
+public:
+    enum {Dpi = 96};
+
+    explicit Snapshot(const ArgumentParser & arguments):
+        mDir(arguments.Png()),
+        mRanges(arguments.Ranges()),
+        mSize(arguments.Size()),
+        mChannels(arguments.Channels()),
+        mFont(QApplication::font())
+    {
+    }
+
+    // the number of info files with errors
+    int run(const QStringList & infos) const
+    {
+        MeasurePerformance measure("Snapshot::run");
+        QDir().mkpath(mDir);
+
+        std::vector<QFuture<QString>> errors;
+
+        for (auto & info:infos)
+        {
+            errors.push_back(QtConcurrent::run(&Headless::Pool(), [this, info]() {return render(info);}));
+        }
+
+        int result = 0;
+
+        for (int index = 0; index < infos.size(); ++index)
+        {
+            const QString error = errors[static_cast<size_t>(index)].result();
+            if (error.isEmpty()) continue;
+            std::cout << infos[index].toStdString() << ": " << error.toStdString() << std::endl;
+            ++result;
+        }
+
+        return result;
+    }
+
+    // one row per channel, each zoomed to its values within begin..end
+    static QImage Image(const std::vector<const DataChannel *> & channels,
+            const QSize & size, const QFont & font, Second begin, Second end)
+    {
+        QImage result(size, QImage::Format_ARGB32_Premultiplied);
+        result.fill(Qt::white);
+        QPainter painter(&result);
+        const int count = static_cast<int>(channels.size());
+
+        for (int index = 0; index < count; ++index)
+        {
+            // rows share the height
+            const int top = index * size.height() / count;
+            const int bottom = (index + 1) * size.height() / count;
+            const QRect rect(0, 0, size.width(), bottom - top);
+            QImage row(rect.size(), QImage::Format_ARGB32_Premultiplied);
+            const DataChannel & chan = *channels[static_cast<size_t>(index)];
+
+            UnitScale time(25.0, "s");
+            time.setPixelSize(rect.width());
+            time.fit(begin, std::max(end, begin + 1e-3));
+
+            UnitScale value(10.0, chan.unit());
+            value.setPixelPerMillimeter(Dpi, 25.4);
+            value.setPixelSize(rect.height());
+            const DataFile::MinMax mm = VisibleRange(chan, time, value);
+            value.autoZoom(mm.min, mm.max);
+
+            DrawChannel(row, font, rect, chan, time, value);
+            painter.drawImage(0, top, row);
+        }
+
+        return result;
+    }
+private:
+    const QString mDir;
+    const std::vector<ArgumentParser::Range> mRanges;
+    const QSize mSize;
+    const std::vector<int> mChannels;
+    const QFont mFont;
+
+    // an empty string or the error
+    QString render(const QString & info) const
+    {
+        DataMain data(info);
+        if (!data.valid()) return data.error().trimmed();
+
+        // built-in beat detections belong to the picture
+        data.finishDetecting();
+
+        std::vector<const DataChannel *> channels;
+        for (size_t index = 0; index < data.channels().size(); ++index)
+        {
+            if (Headless::IsSelected(mChannels, index)) {channels.push_back(&data.channels()[index]);}
+        }
+
+        if (channels.empty()) return "no channel to render";
+        const QString base = mDir + "/" + QFileInfo(info).completeBaseName();
+
+        if (mRanges.empty())
+        {
+            return save(Image(channels, mSize, mFont, 0, data.duration()), base + ".png");
+        }
+
+        for (auto & range:mRanges)
+        {
+            const QString name = QString("%1_%2-%3s.png").arg(base).arg(range.begin).arg(range.end);
+            const QString error = save(Image(channels, mSize, mFont, range.begin, range.end), name);
+            if (!error.isEmpty()) return error;
+        }
+
+        return QString();
+    }
+
+    static QString save(const QImage & image, const QString & name)
+    {
+        if (image.save(name, "PNG")) return QString();
+        return "cannot write " + name;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class Export
+////////////////////////////////////////////////////////////////////////////////
+
+class Export
+{
+    // Writes the files of the selected channels (after all operators) on
+    // the time grid of the first one, block by block: memory does not
+    // depend on the length of the range. The blocks of all columns are
+    // computed in parallel before they are written.
+public:
+    explicit Export(const ArgumentParser & arguments):
+        mFormat(arguments.ExportFormat()),
+        mOutput(arguments.Output()),
+        mRanges(arguments.Ranges()),
+        mChannels(arguments.Channels())
+    {
+    }
+
+    // 0 or 1 on errors
+    int run(const QStringList & infos) const
+    {
+        MeasurePerformance measure("Export::run");
+        const QString error = (infos.size() == 1) ? write(infos[0]) : QString("one info file expected");
+        if (error.isEmpty()) return 0;
+        std::cerr << error.toStdString() << std::endl;
+        return 1;
+    }
+
+    // one exported file
+    struct Column {std::shared_ptr<const SampleStore> store; double gain; QString name;};
+
+    static QByteArray CsvHeader(const std::vector<Column> & columns)
+    {
+        QStringList header("time [s]");
+        for (auto & column:columns) {header << column.name;}
+        return header.join(',').toUtf8() + "\n";
+    }
+private:
+    const QString mFormat;
+    const QString mOutput;
+    const std::vector<ArgumentParser::Range> mRanges;
+    const std::vector<int> mChannels;
+
+    QString write(const QString & info) const
+    {
+        const DataMain data(info);
+        if (!data.valid()) return data.error().trimmed();
+
+        std::vector<const DataFile *> files;
+        for (size_t index = 0; index < data.channels().size(); ++index)
+        {
+            if (!Headless::IsSelected(mChannels, index)) continue;
+            for (auto & file:data.channels()[index].files()) {files.push_back(&file);}
+        }
+
+        if (files.empty()) return "no channel to export";
+        const double sps = files[0]->sps();
+        const Second begin = mRanges.empty() ? 0 : mRanges[0].begin;
+        const Second end = mRanges.empty() ? data.duration() : mRanges[0].end;
+        const qint64 size = static_cast<qint64>(std::ceil((end - begin) * sps));
+
+        std::vector<Column> columns;
+        for (auto & file:files)
+        {
+            const QString name = QString("%1 [%2]").arg(file->label()).arg(file->unit());
+            columns.push_back(Column{file->resampled(sps, begin, size), file->gain(), name});
+        }
+
+        QFile out(mOutput);
+        const QString error = Headless::Open(out, mOutput);
+        if (!error.isEmpty()) return error;
+        if (mFormat == "csv") {out.write(CsvHeader(columns));}
+
+        std::vector<std::shared_ptr<const SampleStore>> stores;
+        for (auto & column:columns) {stores.push_back(column.store);}
+        std::vector<std::vector<int>> samples(columns.size());
+        QByteArray bytes;
+
+        for (qint64 first = 0; first < size; first += SampleStore::BlockSize)
+        {
+            const qint64 last = std::min(size, first + SampleStore::BlockSize);
+            SampleStore::computeParallel(stores, first, last);
+            for (size_t index = 0; index < columns.size(); ++index) {columns[index].store->read(first, last, samples[index]);}
+
+            bytes.clear();
+            if (mFormat == "csv") {AppendCsv(columns, samples, begin + first / sps, sps, bytes);}
+            if (mFormat == "f32") {AppendBinary(columns, samples, true, bytes);}
+            if (mFormat == "i16") {AppendBinary(columns, samples, false, bytes);}
+            if (out.write(bytes) != bytes.size()) return "write failed";
+        }
+
+        return QString();
+    }
+public:
+    // rows of time and values of all columns
+    static void AppendCsv(const std::vector<Column> & columns, const std::vector<std::vector<int>> & samples,
+            Second time, double sps, QByteArray & dst)
+    {
+        char txt[32];
+        const size_t rows = samples[0].size();
+
+        for (size_t row = 0; row < rows; ++row)
+        {
+            dst.append(txt, std::snprintf(txt, sizeof(txt), "%.6f", time + row / sps));
+
+            for (size_t index = 0; index < columns.size(); ++index)
+            {
+                const double value = columns[index].gain * samples[index][row];
+                dst.append(txt, std::snprintf(txt, sizeof(txt), ",%.7g", value));
+            }
+
+            dst.append('\n');
+        }
+    }
+
+    // frames of all columns, little endian: float32 values or int16 lsb
+    static void AppendBinary(const std::vector<Column> & columns, const std::vector<std::vector<int>> & samples,
+            bool isFloat, QByteArray & dst)
+    {
+        const size_t rows = samples[0].size();
+        const int bytes = isFloat ? 4 : 2;
+        dst.reserve(static_cast<int>(rows * columns.size()) * bytes);
+
+        for (size_t row = 0; row < rows; ++row)
+        {
+            for (size_t index = 0; index < columns.size(); ++index)
+            {
+                const int lsb = samples[index][row];
+                uchar raw[4];
+
+                if (isFloat)
+                {
+                    const float value = static_cast<float>(columns[index].gain * lsb);
+                    quint32 bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    qToLittleEndian<quint32>(bits, raw);
+                }
+                else
+                {
+                    qToLittleEndian<qint16>(static_cast<qint16>(std::max(-32768, std::min(32767, lsb))), raw);
+                }
+
+                dst.append(reinterpret_cast<const char *>(raw), bytes);
+            }
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class Report
+////////////////////////////////////////////////////////////////////////////////
+
+class Report
+{
+    // JSON statistics of every file of the selected channels: over the
+    // whole recording and over every interval between consecutive merged
+    // annotations of its channel. Info files load in parallel, all
+    // intervals of an info file are scanned in parallel.
+public:
+    enum {FlatlineMs = 100};
+
+    struct Stats
+    {
+        SampleStats lsb;
+        qint64 clipped;     // samples at lo or hi
+        qint64 flatline;    // samples in runs of at least minFlat equal samples
+        qint64 longest;     // the longest run of equal samples
+    };
+
+    static Stats Scan(const SampleStore & store, qint64 begin, qint64 end, int lo, int hi, qint64 minFlat)
+    {
+        Stats result = {SampleStats(), 0, 0, 0};
+        std::vector<int> samples;
+        qint64 run = 0;
+        int previous = 0;
+
+        for (qint64 first = std::max<qint64>(0, begin); first < end; first += SampleStore::BlockSize)
+        {
+            store.read(first, std::min(end, first + SampleStore::BlockSize), samples);
+            if (samples.empty()) break;
+            result.lsb.add(samples.data(), static_cast<qint64>(samples.size()));
+
+            for (auto lsb:samples)
+            {
+                if ((lsb <= lo) || (lsb >= hi)) {++result.clipped;}
+                if ((run > 0) && (lsb == previous)) {++run; continue;}
+                finishRun(run, minFlat, result);
+                run = 1;
+                previous = lsb;
+            }
+        }
+
+        finishRun(run, minFlat, result);
+        return result;
+    }
+
+    // The values of the final samples, clipping and flatlines of the
+    // decoded samples: a filter or a "-" line neither hides nor invents
+    // them. Expression lines have no decoded samples to check.
+    static Stats Scan(const DataFile & file, qint64 begin, qint64 end)
+    {
+        const qint64 minFlat = std::max<qint64>(2, static_cast<qint64>(file.sps() * FlatlineMs / 1000));
+        Stats result = Scan(*file.store(), begin, end, file.lsbMin(), file.lsbMax(), minFlat);
+        if (file.rawStore() == file.store()) return result;
+        result.clipped = result.flatline = result.longest = 0;
+        if (!file.rawStore()) return result;
+
+        const qint64 offset = file.rawOffset();
+        const Stats raw = Scan(*file.rawStore(), begin - offset, end - offset, file.lsbMin(), file.lsbMax(), minFlat);
+        result.clipped = raw.clipped;
+        result.flatline = raw.flatline;
+        result.longest = raw.longest;
+        return result;
+    }
+
+    explicit Report(const ArgumentParser & arguments):
+        mOutput(arguments.Output()),
+        mChannels(arguments.Channels())
     {
-        const QPoint delta = evt->globalPos() - mLastPos;
-        move(x()+delta.x(), y()+delta.y());
-        mLastPos = evt->globalPos();
     }
 
-    void mouseReleaseEvent(QMouseEvent *) override
+    // 0 or the number of info files with errors
+    int run(const QStringList & infos) const
     {
-        emit signalMoved();
+        MeasurePerformance measure("Report::run");
+        std::vector<QFuture<QJsonObject>> reports;
+
+        for (auto & info:infos)
+        {
+            reports.push_back(QtConcurrent::run(&Headless::Pool(), [this, info]() {return report(info);}));
+        }
+
+        QJsonArray all;
+        int result = 0;
+
+        for (auto & report:reports)
+        {
+            const QJsonObject object = report.result();
+            if (object.contains("error")) {++result;}
+            all.append(object);
+        }
+
+        QFile out(mOutput);
+        const QString error = Headless::Open(out, mOutput);
+        if (!error.isEmpty()) {std::cerr << error.toStdString() << std::endl;}
+        if (!error.isEmpty() || (out.write(QJsonDocument(all).toJson()) < 0)) {++result;}
+        return result;
     }
+private:
+    const QString mOutput;
+    const std::vector<int> mChannels;
 
-    void resizeEvent(QResizeEvent *) override
+    static void finishRun(qint64 run, qint64 minFlat, Stats & dst)
     {
-        emit signalResized();
+        if (run >= minFlat) {dst.flatline += run;}
+        dst.longest = std::max(dst.longest, run);
     }
 
-    void paintEvent(QPaintEvent *) override
+    QJsonObject report(const QString & info) const
     {
-        QPainter painter(this);
-        painter.setRenderHint(QPainter::Antialiasing, true);
+        QJsonObject result;
+        result["info"] = info;
+        DataMain data(info);
 
-        const QPen black(Qt::black, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-        const int y1 = painter.fontMetrics().ascent();
-        const int y2 = height() - 2;
-        painter.setPen(black);
-        painter.drawText(2, y1, mTimeValue.time);
-        painter.drawText(2, y2, mTimeValue.value);
+        if (!data.valid())
+        {
+            result["error"] = data.error().trimmed();
+            return result;
+        }
 
-        const int w = width();
-        const int h = height();
-        const QPen red(Qt::red, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-        painter.setPen(red);
+        // built-in beat detections delimit intervals as well
+        data.finishDetecting();
 
-        const bool isMeasure = (mTimeValue.mode == TimeValueStrings::Measure);
-        if (isMeasure)
+        struct Task
         {
-            // draw red box to signal measure mode
-            painter.drawRect(1, 1, w-2, h-2);
+            const DataFile * file;
+            qint64 begin;
+            qint64 end;
+            Stats stats;
+        };
+
+        std::vector<Task> tasks;
+        std::vector<size_t> firsts;
+        std::vector<int> channels;
+
+        for (size_t index = 0; index < data.channels().size(); ++index)
+        {
+            if (!Headless::IsSelected(mChannels, index)) continue;
+            const int number = static_cast<int>(index);
+            const DataChannel & chan = data.channels()[index];
+
+            for (auto & file:chan.files())
+            {
+                // the whole recording, then the intervals
+                firsts.push_back(tasks.size());
+                channels.push_back(number);
+                tasks.push_back(Task{&file, 0, file.sampleCount(), Stats()});
+                const std::vector<MergedAnnotation> & annos = chan.mergedAnnotations();
+
+                for (size_t anno = 1; anno < annos.size(); ++anno)
+                {
+                    auto toIndex = [&file](Second sec) {return static_cast<qint64>(std::ceil((sec - file.delay()) * file.sps()));};
+                    tasks.push_back(Task{&file, toIndex(annos[anno - 1].annotation.sec()), toIndex(annos[anno].annotation.sec()), Stats()});
+                }
+            }
         }
-        else
+
+        QtConcurrent::blockingMap(tasks, [](Task & task)
         {
-            // draw red crosshairs to mark the focus point
-            const int x = w / 2;
-            const int y = h / 2;
-            painter.drawLine(0, y, w, y);
-            painter.drawLine(x, 0, x, h);
+            task.stats = Scan(*task.file, task.begin, std::min(task.end, task.file->sampleCount()));
+        });
+
+        QJsonArray files;
+        firsts.push_back(tasks.size());
+
+        for (size_t index = 0; index + 1 < firsts.size(); ++index)
+        {
+            const Task & whole = tasks[firsts[index]];
+            const DataFile & file = *whole.file;
+            const DataChannel & chan = data.channels()[static_cast<size_t>(channels[index])];
+            QJsonObject object;
+            object["channel"] = channels[index];
+            object["label"] = file.label();
+            object["unit"] = file.unit();
+            object["sps"] = file.sps();
+            object["delay"] = file.delay();
+            object["duration"] = file.sampleCount() / file.sps();
+            object["total"] = toJson(file, whole.stats);
+            QJsonArray segments;
+
+            for (size_t task = firsts[index] + 1; task < firsts[index + 1]; ++task)
+            {
+                const size_t anno = task - firsts[index];
+                QJsonObject segment = toJson(file, tasks[task].stats);
+                segment["begin"] = chan.mergedAnnotations()[anno - 1].annotation.sec();
+                segment["end"] = chan.mergedAnnotations()[anno].annotation.sec();
+                segment["from"] = chan.mergedAnnotations()[anno - 1].annotation.txt();
+                segment["to"] = chan.mergedAnnotations()[anno].annotation.txt();
+                segments.append(segment);
+            }
+
+            object["segments"] = segments;
+            files.append(object);
         }
+
+        result["files"] = files;
+        return result;
     }
-};
 
-////////////////////////////////////////////////////////////////////////////////
+    static QJsonObject toJson(const DataFile & file, const Stats & stats)
+    {
+        QJsonObject result;
+        result["count"] = static_cast<double>(stats.lsb.count);
+        if (stats.lsb.count < 1) return result;
 
-class ArgumentParser
-{
-public:
-    ArgumentParser();
-    void ParseList(QStringList list);
-    void PrintUsage();
-    bool IsInvalid() const {return mIsInvalid;}
-    bool IsUnitTest() const {return mIsUnitTest;}
-    bool IsDrawPoints() const {return mDrawPoints;}
-    bool IsShowHelp() const {return mIsShowHelp;}
-    const QStringList & Files() const {return mFiles;}
-private:
-    void ParseLine(const QString & file);
-    bool mIsInvalid;
-    bool mIsUnitTest;
-    bool mDrawPoints;
-    bool mIsShowHelp;
-    QString mApplication;
-    QStringList mFiles;
+        const double one = file.gain() * stats.lsb.min;
+        const double two = file.gain() * stats.lsb.max;
+        result["min"] = std::min(one, two);
+        result["max"] = std::max(one, two);
+        result["mean"] = file.gain() * stats.lsb.mean();
+        result["rms"] = std::abs(file.gain()) * stats.lsb.rms();
+        if (!file.rawStore()) return result;
+        result["clipped"] = static_cast<double>(stats.clipped);
+        result["flatline"] = stats.flatline / file.sps();
+        result["longest_flatline"] = stats.longest / file.sps();
+        return result;
+    }
 };
-    
+
+////////////////////////////////////////////////////////////////////////////////
+// class Generator
 ////////////////////////////////////////////////////////////////////////////////
 
-static QString FormatTime(double seconds)
+class Generator
 {
-    int64_t us = static_cast<int64_t>(std::round(std::abs(1e6 * seconds)));
-    int64_t ms = us / 1e3;
-    us -= ms * 1e3;
-    auto msstr = [](int64_t mst, int64_t ust) {
-        return QString("%1.%2ms").arg(mst).arg(ust, 3, 10, QChar('0'));
-    };
-
-    if (GlobalSetup::Instance().displayMilliSeconds())
+    // Synthetic recordings: beats with noise and baseline wander per lead,
+    // one data file per lead or interleaved, and an annotation file.
+public:
+    explicit Generator(const ArgumentParser::Synthetic & setup):
+        mSetup(setup)
     {
-        return msstr(ms, us);
     }
 
-    int64_t factor = 1000 * 60 * 60;
-    const int64_t hour = ms / factor;
-    ms -= hour * factor;
-    factor /= 60;
-    const int64_t min = ms / factor;
-    ms -= min * factor;
-    factor /= 60;
-    const int64_t sec = ms / factor;
-    ms -= sec * factor;
-        
-    QString result;
-    QTextStream s(&result);
-    if (seconds < 0) s << "-";
-    if (hour != 0) s << hour << "h";
-    if ( min != 0) s << min  << "m";
-    if ( sec != 0) s << sec  << "s";
-    s << msstr(ms, us);
-    return result;
-}
+    // the info file or an empty string on errors
+    QString write(const QString & dir) const
+    {
+        MeasurePerformance measure("Generator::write");
+        if (!QDir().mkpath(dir)) return QString();
+        const QString info = dir + "/bench.info";
+        QFile file(info);
+        if (!file.open(QIODevice::WriteOnly)) return QString();
+        QTextStream out(&file);
+        const int files = mSetup.isInterleaved ? 1 : mSetup.leads;
 
-////////////////////////////////////////////////////////////////////////////////
-// class DrawChannel
-////////////////////////////////////////////////////////////////////////////////
-    
-DrawChannel::DrawChannel(QWidget & parent,
-            const QRect & rect,
-            const DataChannel & chan,
-            const UnitScale & timeScale,
-            const UnitScale & valueScale):
-    mParent(parent),
-    mRect(rect),
-    mTranslate(timeScale, valueScale),
-    mPainter(&parent),
-    mMeasurePerformance("DrawChannel"),
-    mDefaultPen(Qt::magenta, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin),
-    mColorSchema()
-{
-    mPainter.setRenderHint(QPainter::Antialiasing, true);
-    mPainter.fillRect(mRect, Qt::white);
-    DrawAnnotations(chan);
+        for (int lead = 0; lead < mSetup.leads; ++lead)
+        {
+            const QString data = mSetup.isInterleaved ? QString("bench.dat") : QString("lead%1.dat").arg(lead);
+            out << data << " " << mSetup.sps << " 1 mV \"L" << lead << "\" gain=0.005 anno_file=bench.anno";
+            if (mSetup.isInterleaved) {out << " interleave " << mSetup.leads << " " << lead << " 1";}
+            out << endl;
+        }
 
-    size_t dataIndex = 0;
-    for (auto & data:chan.files())
+        for (int index = 0; index < files; ++index)
+        {
+            const QString data = mSetup.isInterleaved ? QString("bench.dat") : QString("lead%1.dat").arg(index);
+            if (!writeData(dir + "/" + data, mSetup.isInterleaved ? -1 : index)) return QString();
+        }
+
+        return writeAnno(dir + "/bench.anno") ? info : QString();
+    }
+private:
+    const ArgumentParser::Synthetic mSetup;
+
+    // one lead, or all leads interleaved (lead < 0)
+    bool writeData(const QString & name, int lead) const
     {
-        SetColorSchema(dataIndex++);
-        mTranslate.setData(data);
-        //mTranslate.debug(rect);
+        QFile file(name);
+        if (!file.open(QIODevice::WriteOnly)) return false;
+        const qint64 count = static_cast<qint64>(mSetup.seconds) * mSetup.sps;
+        const int first = (lead < 0) ? 0 : lead;
+        const int last = (lead < 0) ? mSetup.leads : (lead + 1);
+        QByteArray bytes;
+        quint32 noise = 12345;
 
-        if (data.samples().size() > 1)
+        for (qint64 index = 0; index < count; ++index)
         {
-            if (mTranslate.samplesPerPixel() > 5)
+            for (int channel = first; channel < last; ++channel)
             {
-                DrawPixelWise(data);
+                const double t = static_cast<double>(index) / mSetup.sps;
+                const double phase = std::fmod(t, 0.8) - 0.3;
+                // up to twice the first lead, in range for any number of leads
+                const double beat = 1000 * std::exp(-phase * phase / 0.0002) * (1 + static_cast<double>(channel) / mSetup.leads);
+                const double wander = 200 * std::sin(2 * M_PI * 0.2 * t + channel);
+                noise = noise * 1103515245 + 12345;
+                const qint16 lsb = static_cast<qint16>(beat + wander + ((noise >> 16) % 41) - 20);
+                uchar raw[2];
+                if (mSetup.isLittleEndian) {qToLittleEndian<qint16>(lsb, raw);}
+                else                       {qToBigEndian<qint16>(lsb, raw);}
+                bytes.append(reinterpret_cast<const char *>(raw), 2);
             }
-            else
+
+            if (bytes.size() >= (1 << 20))
             {
-                DrawSampleWise(data);
+                if (file.write(bytes) != bytes.size()) return false;
+                bytes.clear();
             }
         }
+
+        return file.write(bytes) == bytes.size();
     }
 
-    mTranslate.resetData();
-    DrawDecorations(chan);
-    DrawRulers();
-    DrawRange();
-}
+    bool writeAnno(const QString & name) const
+    {
+        QFile file(name);
+        if (!file.open(QIODevice::WriteOnly)) return false;
+        QTextStream out(&file);
+        const qint64 count = static_cast<qint64>(mSetup.seconds) * mSetup.annosPerMinute / 60;
 
-void DrawChannel::DrawDecorations(const DataChannel & chan)
-{
-    const int x = 20;
-    const int step = mPainter.fontMetrics().height();
-    int y = 2 * step;
+        for (qint64 index = 0; index < count; ++index)
+        {
+            out << (index * 60000 / mSetup.annosPerMinute) << " " << ((index % 10) ? "N" : "V") << "\n";
+        }
 
-    size_t dataIndex = 0;
-    for (auto & data:chan.files())
-    {
-        SetColorSchema(dataIndex++);
-        mPainter.setPen(mDefaultPen);
-        mPainter.drawText(QPoint(x, y), data.label());
-        y += step;
+        return true;
     }
-}
+};
 
-void DrawChannel::DrawRange()
-{
-    const QPen rulerPen(Qt::black, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-    mPainter.setPen(rulerPen);
-    const int pxmax = 0;
-    const int pxmin = mParent.height();
-    const double max = mTranslate.ypxToUnit(pxmax);
-    const double min = mTranslate.ypxToUnit(pxmin);
-    const int as = mPainter.fontMetrics().ascent();
-    const QString unit = mTranslate.Y().unit();
-    mPainter.drawText(QPoint(0, pxmax + as), QString::number(max) + unit);
-    mPainter.drawText(QPoint(0, pxmin), QString::number(min) + unit);
-}
+////////////////////////////////////////////////////////////////////////////////
+// class Benchmark
+////////////////////////////////////////////////////////////////////////////////
 
-void DrawChannel::DrawRulers()
+class Benchmark
 {
-    const QPen rulerPen(Qt::black, 1, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-    mPainter.setPen(rulerPen);
-    const UnitScale & xs = mTranslate.X();
-    const UnitScale & ys = mTranslate.Y();
-    const double xmm = 25;
-    const double ymm = 10;
-    const int x1 = mParent.width() - 10;
-    const int y1 = mParent.height() - 10;
-    const int x2 = x1 - xs.millimeterToPixel(xmm);
-    const int y2 = y1 - ys.millimeterToPixel(ymm);
-    mPainter.drawLine(QPoint(x1, y1), QPoint(x2, y1));
-    mPainter.drawLine(QPoint(x1, y1), QPoint(x1, y2));
-    mPainter.drawLine(QPoint(x2, (y1 - 3)), QPoint(x2, (y1 + 3)));
-    mPainter.drawLine(QPoint((x1 - 3), y2), QPoint((x1 + 3), y2));
-    
-    const double xu = xmm / xs.mmPerUnit();
-    const double yu = ymm / ys.mmPerUnit();
-    const QString xt = FormatTime(xu);
-    const QString yt = QString::number(yu) + ys.unit();
-    const auto fm = mPainter.fontMetrics();
-    const QRect yb = fm.boundingRect(yt);
-    mPainter.drawText(QPoint((x1 - yb.width() - 3), (y2 + fm.ascent())), yt);
-    mPainter.drawText(QPoint((x2 + 3), y1 - 3), xt);
-}
+    // Load and decode steps of an info file, one line per step with the
+    // throughput and the peak resident memory so far:
+    // "bench <name> ms=<ms> msps=<Msamples/s> mbps=<MB/s> rss_mb=<MB>"
+public:
+    enum {ParseLines = 100000};
 
-void DrawChannel::DrawAnnotations(const DataChannel & chan)
+    // 0 or 1 on errors
+    int run(const QString & info) const
+    {
+        QFile file(info);
+        if (!file.open(QIODevice::ReadOnly)) {std::cerr << "cannot read " << info.toStdString() << std::endl; return 1;}
+        const QString path = QFileInfo(info).path() + "/";
+        QStringList lines;
+        QTextStream in(&file);
+
+        while (!in.atEnd())
+        {
+            const QString line = in.readLine();
+            if (line.trimmed().isEmpty() || line.startsWith('#')) continue;
+            lines << line;
+        }
+
+        if (lines.isEmpty()) {std::cerr << "no info lines" << std::endl; return 1;}
+        GlobalSetup & gs = GlobalSetup::Instance();
+        const ByteOrderMode mode = gs.byteOrder();
+        QElapsedTimer timer;
+
+        // info parsing only: the same line without data
+        const QRegularExpression annoFile("\\s*anno_file=\\S+");
+        const QString dummy = QString(lines[0])
+            .replace(QRegularExpression("^(\\s*[>+-]?\\s*)\\S+"), "\\1dummy")
+            .replace(annoFile, "");
+        timer.start();
+        for (int index = 0; index < ParseLines; ++index) {DataFile parse(dummy, path);}
+        report("parseInfo", timer.nsecsElapsed(), ParseLines, dummy.size() * static_cast<qint64>(ParseLines));
+
+        // readData, then the byte order detection on the same samples
+        std::vector<int> decoded;
+        qint64 samples = 0;
+        qint64 readNs = 0;
+        qint64 detectNs = 0;
+        gs.setByteOrder(KeepByteOrder);
+
+        for (auto & line:lines)
+        {
+            DataFile file(QString(line).replace(annoFile, ""), path);
+            timer.start();
+            file.decode(decoded);
+            readNs += timer.nsecsElapsed();
+            timer.start();
+            file.detectByteOrder(decoded);
+            detectNs += timer.nsecsElapsed();
+            samples += static_cast<qint64>(decoded.size());
+        }
+
+        gs.setByteOrder(mode);
+        const qint64 bytes = samples * 2;
+        report("readData", readNs, samples, bytes);
+        report("autoByteOrder", detectNs, samples, bytes);
+        std::vector<DataFile> files;
+        for (auto & line:lines) {files.push_back(DataFile(line, path));}
+
+        // annotations only
+        qint64 annos = 0;
+        timer.start();
+
+        for (auto & file:files)
+        {
+            const QRegularExpression anno("anno_file=(\\S+)");
+            const QRegularExpressionMatch match = anno.match(file.txt());
+            if (!match.hasMatch()) continue;
+            annos += DataFile(dummy + " anno_file=" + match.captured(1), path).annotations().size();
+        }
+
+        report("readAnno", timer.nsecsElapsed(), annos, 0);
+
+        // the difference of two files, computed for every sample
+        if (files.size() > 1)
+        {
+            timer.start();
+            DataFile difference(files[0]);
+            difference.minus(files[1]);
+            const SampleStats stats = difference.lsbStats(0, difference.sampleCount());
+            report("minus", timer.nsecsElapsed(), stats.count, 0);
+        }
+
+        // merging all annotations of one channel with all files
+        DataChannel channel;
+        for (auto & file:files) {channel.plus(file);}
+        timer.start();
+        channel.done();
+        report("done", timer.nsecsElapsed(), static_cast<qint64>(channel.mergedAnnotations().size()), 0);
+
+        // everything together as the viewer does
+        timer.start();
+        const DataMain data(info);
+        report("DataMain", timer.nsecsElapsed(), samples, bytes);
+        return data.valid() ? 0 : 1;
+    }
+private:
+    static void report(const char * name, qint64 ns, qint64 count, qint64 bytes)
+    {
+        const double ms = ns / 1e6;
+        const double seconds = std::max(1e-9, ns / 1e9);
+        std::cout << "bench " << name
+            << " ms=" << ms
+            << " msps=" << (count / seconds / 1e6)
+            << " mbps=" << (bytes / seconds / 1e6)
+            << " rss_mb=" << (PeakRss() / 1e6)
+            << std::endl;
+    }
+
+    static qint64 PeakRss()
+    {
+#ifdef Q_OS_UNIX
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef Q_OS_MAC
+        return usage.ru_maxrss;
+#else
+        return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+#else
+        return 0;
+#endif
+    }
+};
+
+class RenderBench
 {
-    const int flags = Qt::TextSingleLine|Qt::TextDontClip;
-    const int requestLeft = mRect.left();
-    const int requestRight = mRect.right();
-    const int max = INT_MAX;
-    QRect lastBounds(INT_MIN, 0, 0, 0);
-    const int bottom = mParent.rect().bottom();
-    int annosPerPixel = 0;
-    int annosDisplayed = 0;
+    // DrawChannel over a matrix of zoom levels, channel counts and
+    // annotation densities on synthetic recordings. Every image is drawn
+    // several times for the frame times and compared with the golden one
+    // of the same name, one line per case:
+    // "render <case> ms=<median> min_ms=<min> diff=<pixels> <ok|FAIL>"
+    // A missing golden image fails, --update-golden writes them ("new").
+public:
+    enum {Repeat = 5, Seconds = 600, Sps = 500, Leads = 12};
 
-    for (auto & merged:chan.mergedAnnotations())
+    explicit RenderBench(const ArgumentParser & arguments):
+        mDir(arguments.Golden()),
+        mSize(arguments.Size()),
+        mIsUpdate(arguments.IsUpdateGolden()),
+        mTolerance(arguments.Tolerance()),
+        mFont(QApplication::font())
     {
-        SetColorSchema(merged.fileIndex);
-        const QPen annoPen(mColorSchema.anno, 1, Qt::DotLine, Qt::RoundCap, Qt::RoundJoin);
-        mPainter.setPen(annoPen);
+    }
 
-        auto & anno = merged.annotation;
-        const int textLeft = mTranslate.secondToXpx(anno.sec());
-        if (textLeft > requestRight) return;
-        QRect bounds(textLeft, lastBounds.top(), max, max);
-        bounds = mPainter.boundingRect(bounds, flags, anno.txt());
-        const bool isOverlapping = bounds.left() < lastBounds.right();
+    // the number of failed cases, 1 on errors
+    int run() const
+    {
+        if (!QDir().mkpath(mDir)) {std::cerr << "cannot write " << mDir.toStdString() << std::endl; return 1;}
+        QTemporaryDir tmp;
+        int result = 0;
+
+        // samples per pixel, 0 for the whole recording
+        const std::vector<std::pair<QString, double>> zooms = {
+            {"points", 0.25}, {"lines", 2}, {"pixels", 50}, {"overview", 0}};
+
+        for (int annos:{0, 60, 600})
+        {
+            const ArgumentParser::Synthetic setup{Seconds, Leads, Sps, annos, false, false};
+            const QString dir = QString("%1/anno%2").arg(tmp.path()).arg(annos);
+            const QString info = Generator(setup).write(dir);
+            const DataMain data(info);
+            if (info.isEmpty() || !data.valid()) {std::cerr << "cannot generate " << dir.toStdString() << std::endl; return 1;}
+
+            for (int count:{1, 4, 12})
+            {
+                std::vector<const DataChannel *> channels;
+                for (int index = 0; index < count; ++index) {channels.push_back(&data.channels()[static_cast<size_t>(index)]);}
+
+                for (auto & zoom:zooms)
+                {
+                    const Second length = (zoom.second > 0) ? (zoom.second * mSize.width() / Sps) : data.duration();
+                    const Second begin = (zoom.second > 0) ? (Seconds / 3.0) : 0;
+                    const QString name = QString("%1_ch%2_anno%3").arg(zoom.first).arg(count).arg(annos);
+                    result += measure(name, channels, begin, begin + length) ? 0 : 1;
+                }
+            }
+        }
+
+        return result;
+    }
 
-        if (isOverlapping)
+    // the number of differing pixels, -1 for different sizes
+    static qint64 Difference(const QImage & a, const QImage & b, QImage * diff = nullptr)
+    {
+        if (a.size() != b.size()) return -1;
+        const QImage x = a.convertToFormat(QImage::Format_ARGB32);
+        const QImage y = b.convertToFormat(QImage::Format_ARGB32);
+        if (diff) {*diff = QImage(a.size(), QImage::Format_ARGB32); diff->fill(Qt::white);}
+        qint64 result = 0;
+
+        for (int row = 0; row < x.height(); ++row)
         {
-            bounds.moveTop(lastBounds.bottom());
+            const QRgb * lineX = reinterpret_cast<const QRgb *>(x.constScanLine(row));
+            const QRgb * lineY = reinterpret_cast<const QRgb *>(y.constScanLine(row));
 
-            if (bounds.bottom() > mParent.height())
+            for (int column = 0; column < x.width(); ++column)
             {
-                bounds.moveTop(0);
+                if (lineX[column] == lineY[column]) continue;
+                ++result;
+                if (diff) {diff->setPixel(column, row, qRgb(255, 0, 0));}
             }
         }
-        else
+
+        return result;
+    }
+
+    // one case, true when the golden image matches or was written
+    bool measure(const QString & name, const std::vector<const DataChannel *> & channels, Second begin, Second end) const
+    {
+        std::vector<qint64> times;
+        QImage image;
+        QElapsedTimer timer;
+
+        for (int index = 0; index < Repeat; ++index)
         {
-            bounds.moveTop(0);
+            timer.start();
+            image = Snapshot::Image(channels, mSize, mFont, begin, end);
+            times.push_back(timer.nsecsElapsed());
         }
 
-        if (lastBounds.x() == bounds.x())
+        std::sort(times.begin(), times.end());
+        std::cout << "render " << name.toStdString()
+            << " ms=" << (times[times.size() / 2] / 1e6)
+            << " min_ms=" << (times[0] / 1e6);
+
+        const QString golden = mDir + "/" + name + ".png";
+        const QImage expected(golden);
+
+        if (mIsUpdate)
         {
-            ++annosPerPixel;
+            const bool isSaved = image.save(golden, "PNG");
+            std::cout << (isSaved ? " new" : " cannot write") << std::endl;
+            return isSaved;
         }
-        else
+
+        if (expected.isNull())
         {
-            annosPerPixel = 0;
+            std::cout << " missing FAIL" << std::endl;
+            image.save(mDir + "/" + name + ".actual.png", "PNG");
+            return false;
         }
 
-        lastBounds = bounds;
-        if (bounds.right() < requestLeft) continue;
-        if ((annosPerPixel > 1) && (annosDisplayed > 1000)) continue;
-        mPainter.drawText(bounds.bottomLeft(), anno.txt());
-        mPainter.drawLine(bounds.bottomLeft(), QPoint(bounds.left(), bottom));
-        ++annosDisplayed;
+        QImage diff;
+        const qint64 pixels = Difference(image, expected, &diff);
+        const qint64 allowed = static_cast<qint64>(mTolerance / 100 * image.width() * image.height());
+        const bool isOk = (pixels >= 0) && (pixels <= allowed);
+        std::cout << " diff=" << pixels << (isOk ? " ok" : " FAIL") << std::endl;
+
+        // what differs, for a look at the failures
+        if (!isOk) {image.save(mDir + "/" + name + ".actual.png", "PNG");}
+        if (!isOk && (pixels > 0)) {diff.save(mDir + "/" + name + ".diff.png", "PNG");}
+        return isOk;
     }
-}
+private:
+    const QString mDir;
+    const QSize mSize;
+    const bool mIsUpdate;
+    const double mTolerance;
+    const QFont mFont;
+};
 
-void DrawChannel::DrawPixelWise(const DataFile & data)
+////////////////////////////////////////////////////////////////////////////////
+// new gui
+////////////////////////////////////////////////////////////////////////////////
+
+class GuiWave : public QWidget
 {
-    mPainter.setPen(mDefaultPen);
-    const int indexEnd = static_cast<int>(data.samples().size()) - 1;
-    const int xpxEnd = mRect.right() + 2;
-        
-    for (int xpx = mRect.left(); xpx < xpxEnd; ++xpx)
+    Q_OBJECT
+public:
+    // Without scales the time scale shows all seconds and the value
+    // scale all values. Rows of GuiMain share the time scale.
+    explicit GuiWave(QWidget * parent, const DataChannel & data, double seconds,
+            const UnitScale * time = nullptr, const UnitScale * value = nullptr):
+        QWidget(parent),
+        mData(data),
+        mResizeCounter(0),
+        mTimeScale(time ? *time : UnitScale(25.0, "s")),
+        mValueScale(value ? *value : UnitScale(10.0, data.unit())),
+        mRefineTimer(),
+        mPrefetchTimer(),
+        mIsInteractive(false),
+        mPixelStep(1),
+        mBacking(),
+        mDirty(),
+        mPendingScroll(0),
+        mPendingRedraw(false),
+        mMotion(MotionNone),
+        mPrefetch(),
+        mPrefetchDone(),
+        mFrames()
     {
-        int indexFirst = mTranslate.xpxToSampleIndex(xpx);
-        if (indexFirst < 0) indexFirst = 0;
-        if (indexFirst > indexEnd) return;
+        qDebug() << "GuiWave::ctor";
+        // every pixel is copied from mBacking
+        setAttribute(Qt::WA_OpaquePaintEvent);
+        mRefineTimer.setSingleShot(true);
+        mRefineTimer.setInterval(RefineDelayMs);
+        connect(&mRefineTimer, SIGNAL(timeout()), this, SLOT(slotRefine()));
+        mPrefetchTimer.setSingleShot(true);
+        mPrefetchTimer.setInterval(PrefetchDelayMs);
+        connect(&mPrefetchTimer, SIGNAL(timeout()), this, SLOT(slotPrefetch()));
+
+        if (!time)
+        {
+            mTimeScale.setXResolution();
+            mTimeScale.setPixelSize(width());
+            mTimeScale.autoZoom(0, seconds);
+        }
 
-        int indexLast = mTranslate.xpxToSampleIndex(xpx + 1);
-        if (indexLast > indexEnd) indexLast = indexEnd;
-        if (indexLast < 0) continue;
+        if (!value)
+        {
+            mValueScale.setYResolution();
+            mValueScale.setPixelSize(height());
+            yzoomAuto();
+        }
 
-        // 1st line per xpx:
-        // - from last sample in previous xpx
-        // - to first sample in current xpx
-        auto itFirst = data.samples().begin() + indexFirst;
-        auto first = mTranslate.lsbToYpx(*itFirst);
-        auto last = mTranslate.lsbToYpx(*(itFirst - 1));
-        mPainter.drawLine(xpx - 1, last, xpx, first);
-
-        // 2nd line per xpx:
-        // - from min sample in current xpx
-        // - to max sample in current xpx
-        auto itLast = itFirst + (indexLast - indexFirst);
-        auto minmax = std::minmax_element(itFirst, itLast);
-        auto min = mTranslate.lsbToYpx(*minmax.first);
-        auto max = mTranslate.lsbToYpx(*minmax.second);
-        mPainter.drawLine(xpx, min, xpx, max);
+        setFocusPolicy(Qt::StrongFocus);
     }
-}
 
-void DrawChannel::DrawSampleWise(const DataFile & data)
-{
-    const int indexLeft = mTranslate.xpxToSampleIndex(mRect.left() - 1) - 1;
-    const int indexRight = mTranslate.xpxToSampleIndex(mRect.right() + 1) + 1;
-    const int indexBegin = data.clipIndex(indexLeft);
-    const int indexEnd = data.clipIndex(indexRight);
-    if ((indexEnd - indexBegin) < 1) return;
+    ~GuiWave()
+    {
+        // the prefetch task reads only mData and stops after its current
+        // block or image, WaitForPrefetch before the data is deleted
+        interrupt();
+    }
 
-    QPen linePen = mDefaultPen;
-    const QPen pointPen(mColorSchema.dark, 3, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-    const bool drawPoints = mTranslate.samplesPerPixel() < 0.5;
-    auto indexNow = indexBegin;
-    auto now  = data.samples().begin() + indexNow;
-    auto end  = data.samples().begin() + indexEnd;
-    auto yold = mTranslate.lsbToYpx(*now);
-    auto xold = mTranslate.sampleIndexToXpx(indexNow);
-    ++now;
-    ++indexNow;
+    static void WaitForPrefetch()
+    {
+        PrefetchPool().waitForDone();
+    }
 
-    if (drawPoints)
+    // the prefetch task stops after its current block or image
+    void cancelPrefetch()
     {
-        linePen.setColor(mColorSchema.normal);
-        mPainter.setPen(pointPen);
-        mPainter.drawPoint(xold, yold);
+        interrupt();
     }
 
-    while (now <= end)
+    bool isPrefetching() const
     {
-        auto ynow = mTranslate.lsbToYpx(*now);
-        auto xnow = mTranslate.sampleIndexToXpx(indexNow);
-        ++now;
-        ++indexNow;
-        mPainter.setPen(linePen);
-        mPainter.drawLine(xold, yold, xnow, ynow);
-        xold = xnow;
-        yold = ynow;
+        return mPrefetchDone.isRunning();
+    }
 
-        if (drawPoints)
+    // Annotations were added in first..last: render again if they are in
+    // view or in the label layout left of it, drop the prefetched images
+    // showing them.
+    void annotationsAdded(Second first, Second last)
+    {
+        if ((last >= DrawChannel::LabelStart(mTimeScale)) && (first <= mTimeScale.max()))
         {
-            mPainter.setPen(pointPen);
-            mPainter.drawPoint(xnow, ynow);
+            redraw();
+            return;
         }
+
+        if (!mPrefetch) return;
+        QMutexLocker lock(&mPrefetch->mutex);
+        auto isShowing = [first, last](const Prefetch::Frame & frame)
+        {
+            return (last >= DrawChannel::LabelStart(frame.time)) && (first <= frame.time.max());
+        };
+        auto & frames = mPrefetch->frames;
+        frames.erase(std::remove_if(frames.begin(), frames.end(), isShowing), frames.end());
     }
-}
 
-void DrawChannel::SetColorSchema(size_t index)
-{
-    static const std::vector<ColorSchema> schema = {
-        {Qt::black,     Qt::gray,  Qt::lightGray},
-        {Qt::darkGreen, Qt::green, Qt::green},
-        {Qt::darkRed,   Qt::red,   Qt::red},
-        {Qt::darkBlue,  Qt::blue,  Qt::blue},
-    };
+    const DataChannel & channel() const {return mData;}
+    const UnitScale & timeScale() const {return mTimeScale;}
+    const UnitScale & valueScale() const {return mValueScale;}
 
-    if (index >= schema.size()) {index = 0;}
-    mColorSchema = schema[index];
-    mDefaultPen.setColor(mColorSchema.dark);
-}
+    QString FormatValue(double value) const
+    {
+        QString result;
+        QTextStream ss(&result);
+        ss << value << mValueScale.unit();
+        return result;
+    }
 
-////////////////////////////////////////////////////////////////////////////////
-// class ArgumentParser
-////////////////////////////////////////////////////////////////////////////////
+    TimeValueStrings focusStrings() const
+    {
+        TimeValueStrings p;
+        p.time = FormatTime(mTimeScale.focus());
+        p.value = FormatValue(mValueScale.focus());
+        p.mode = TimeValueStrings::Position;
+        return p;
+    }
 
-ArgumentParser::ArgumentParser():
-    mIsInvalid(false),
-    mIsUnitTest(false),
-    mDrawPoints(false),
-    mIsShowHelp(false),
-    mFiles()
-{
-}
+    TimeValueStrings measureStrings(QWidget * ptr) const
+    {
+        TimeValueStrings p;
+        p.time = FormatTime(mTimeScale.pixelToUnit(ptr->width()));
+        p.value = FormatValue(mValueScale.pixelToUnit(ptr->height()));
+        p.mode = TimeValueStrings::Measure;
+        return p;
+    }
 
-void ArgumentParser::ParseList(QStringList list)
-{
-    if (list.size() > 0)
+    QString zoomString() const
     {
-        mApplication = list[0];
+        QString result;
+        QTextStream s(&result);
+        s << "zoom = ";
+        s << mTimeScale.mmPerUnit() << "mm/" << mTimeScale.unit() << ", ";
+        s << mValueScale.mmPerUnit() << "mm/" << mValueScale.unit();
+        return result;
     }
 
-    for (int index = 1; index < list.size(); ++index)
+    QString timeString() const
     {
-        ParseLine(list[index]);
+        QString result;
+        QTextStream s(&result);
+
+        if (mData.files().size() > 0)
+        {
+            const DataFile & file = mData.files()[0];
+            s << "data = " << FormatTime(file.duration()) << ", ";
+        }
+
+        s << "visible = {" << FormatTime(mTimeScale.min());
+        s << ", " << FormatTime(mTimeScale.max()) << "}";
+        return result;
     }
-}
 
-void ArgumentParser::ParseLine(const QString & line)
-{
-    if ((line == QString("-t")) || (line == QString("--test")))
+    QString statsString(const QWidget * box) const
     {
-        mIsUnitTest = true;
-        return;
+        // statistics of every file within the time span of the box
+        QString result;
+        QTextStream s(&result);
+        const QRect geo = box->geometry();
+
+        for (auto & data:mData.files())
+        {
+            Translate t(mTimeScale, mValueScale);
+            t.setData(data);
+            const qint64 indexBegin = t.xpxToSampleIndex(geo.left());
+            const qint64 indexEnd = t.xpxToSampleIndex(geo.right() + 1);
+            const DataFile::Stats st = data.stats(indexBegin, indexEnd);
+            if (st.count < 1) continue;
+            if (result.size() > 0) s << " | ";
+            s << data.label() << ":";
+            s << " p2p=" << FormatValue(st.max - st.min);
+            s << " mean=" << FormatValue(st.mean);
+            s << " rms=" << FormatValue(st.rms);
+            s << " min=" << FormatValue(st.min);
+            s << " max=" << FormatValue(st.max);
+        }
+
+        return result;
     }
 
-    if ((line == QString("-p")) || (line == QString("--points")))
+    QString valueString() const
     {
-        mDrawPoints = true;
-        return;
+        QString result;
+        QTextStream s(&result);
+        s << "visible = {" << FormatValue(mValueScale.min());
+        s << ", " << FormatValue(mValueScale.max()) << "}";
+        return result;
     }
 
-    if ((line == QString("-h")) || (line == QString("--help")))
+    void setXFocus(int xpx)
     {
-        mIsShowHelp = true;
-        return;
+        mTimeScale.setFocusPixel(xpx);
     }
 
-    const QRegExp longOption("--(\\w+)");
+    Second focusTime() const
+    {
+        return mTimeScale.focus();
+    }
 
-    if (longOption.exactMatch(line))
+    Second secondsPerPixel() const
     {
-        std::cout << "Unknown option: " << longOption.cap(0).toStdString() << std::endl;
-        mIsInvalid = true;
-        return;
+        return mTimeScale.pixelToUnit(1);
+    }
+
+    // scrolls sec to the center, by whole pixels (see applyPending)
+    void centerAt(Second sec)
+    {
+        interrupt();
+        const double px = (sec - mTimeScale.min()) * mTimeScale.pixelPerUnit() - mTimeScale.pixelSize() / 2;
+
+        if (std::abs(px) < mTimeScale.pixelSize())
+        {
+            mPendingScroll += mTimeScale.scrollPixel(static_cast<int>(std::lround(px)));
+            return;
+        }
+
+        // far away (does not fit an int when zoomed in): nothing to reuse
+        mTimeScale.scroll(px / mTimeScale.pixelPerUnit());
+        mPendingRedraw = true;
+    }
+
+    enum Find {FindCrossing, FindExcursion, FindPeak};
+
+    // The nearest sample of any file after (or before) from: crossing the
+    // value at the center of the box, outside of the box's value span, or
+    // the extremum of the next excursion outside of the span.
+    bool findSample(const QWidget * box, Find find, bool isForward, Second from, Second & dst) const
+    {
+        const QRect geo = box->geometry();
+        const Translate t(mTimeScale, mValueScale);
+        const double top = t.ypxToUnit(geo.top());
+        const double bottom = t.ypxToUnit(geo.bottom() + 1);
+        const double level = t.ypxToUnit(geo.center().y());
+        bool result = false;
+
+        for (auto & data:mData.files())
+        {
+            if ((data.sampleCount() < 1) || (data.gain() == 0)) continue;
+
+            // physical values to lsb: (gain * lsb) within [lo, hi]
+            auto toLsb = [](double lsb) {return std::max(-1e9, std::min(1e9, lsb));};
+            const double one = toLsb(bottom / data.gain());
+            const double two = toLsb(top / data.gain());
+            const int lo = static_cast<int>(std::ceil(std::min(one, two)));
+            const int hi = static_cast<int>(std::floor(std::max(one, two)));
+            const int threshold = static_cast<int>(std::ceil(toLsb(level / data.gain())));
+
+            const qint64 nearest = static_cast<qint64>(std::floor((from - data.delay()) * data.sps() + 0.5));
+            const qint64 start = nearest + (isForward ? 1 : -1);
+            SampleSearch search(*data.store());
+            qint64 index = -1;
+
+            switch (find)
+            {
+            case FindCrossing:  index = search.crossing(start, threshold, isForward); break;
+            case FindExcursion: index = search.outside(start, lo, hi, isForward);     break;
+            case FindPeak:      index = search.peak(start, lo, hi, isForward);        break;
+            }
+
+            if (index < 0) continue;
+            const Second sec = data.delay() + index / data.sps();
+            if (result && (isForward ? (sec >= dst) : (sec <= dst))) continue;
+            dst = sec;
+            result = true;
+        }
+
+        return result;
+    }
+
+    void setYFocus(int ypx)
+    {
+        const Translate t(mTimeScale, mValueScale);
+        mValueScale.setFocus(t.ypxToUnit(ypx));
+    }
+
+    void yzoomAuto()
+    {
+        const DataFile::MinMax mm = VisibleRange(mData, mTimeScale, mValueScale);
+        mValueScale.autoZoom(mm.min, mm.max);
+        redraw();
+    }
+
+    void redraw()
+    {
+        // the waves changed: render the whole backing image again,
+        // prefetched images are outdated as well
+        interrupt();
+        mPrefetch.reset();
+        mDirty = rect();
+        update();
+    }
+
+    // Input only changes the scales. Rendering is deferred to applyPending,
+    // which GuiMain calls at most once per frame.
+    void xzoomIn()  {track(MotionZoomIn); mTimeScale.zoomIn(); mPendingRedraw = true;}
+    void xzoomOut() {track(MotionZoomOut); mTimeScale.zoomOut(); mPendingRedraw = true;}
+    void yzoomIn()  {interrupt(); mValueScale.zoomIn(); mPendingRedraw = true;}
+    void yzoomOut() {interrupt(); mValueScale.zoomOut(); mPendingRedraw = true;}
+    void left()     {track(MotionLeft); mPendingScroll += mTimeScale.scrollLeft();}
+    void right()    {track(MotionRight); mPendingScroll += mTimeScale.scrollRight();}
+    void down()     {interrupt(); mValueScale.scrollLeft(); mPendingRedraw = true;}
+    void up()       {interrupt(); mValueScale.scrollRight(); mPendingRedraw = true;}
+
+    void applyPending()
+    {
+        if ((mPendingRedraw || (mPendingScroll != 0)) && usePrefetched())
+        {
+            // rendered while idle, look further ahead
+            mPrefetchTimer.start();
+        }
+        else if (mPendingRedraw)
+        {
+            interact();
+        }
+        else if (mPendingScroll != 0)
+        {
+            scrollPixel(mPendingScroll);
+        }
+
+        mPendingRedraw = false;
+        mPendingScroll = 0;
+    }
+signals:
+    void signalClicked(GuiWave *, QMouseEvent *);
+    void signalSelected(GuiWave *);
+private slots:
+    void slotRefine()
+    {
+        // input has been idle long enough: repaint at full quality
+        mIsInteractive = false;
+        redraw();
+        mPrefetchTimer.start();
+    }
+
+    void slotPrefetch()
+    {
+        // Still idle: render the views of the next steps in the recent
+        // direction on a low priority thread. Blocks they need are
+        // decoded first, so an interrupted task is still useful.
+        interrupt();
+        if (mBacking.isNull() || !isVisible()) return;
+
+        const std::shared_ptr<Prefetch> prefetch = std::make_shared<Prefetch>();
+        const std::vector<UnitScale> targets = prefetchTargets();
+        const UnitScale value(mValueScale);
+        const QSize size = mBacking.size();
+        const int dpr = devicePixelRatio();
+        const QFont font = this->font();
+        const DataChannel & data = mData;
+        mPrefetch = prefetch;
+
+        mPrefetchDone = QtConcurrent::run(&PrefetchPool(), [=, &data]()
+        {
+            QThread::currentThread()->setPriority(QThread::LowestPriority);
+            prefetch->run(data, targets, value, size, dpr, font);
+            QThread::currentThread()->setPriority(QThread::NormalPriority);
+        });
     }
+private:
+    enum
+    {
+        FrameBudgetMs = 20,
+        RefineDelayMs = 250,
+        PrefetchDelayMs = 100,
+        PrefetchSteps = 2,
+        MaxPixelStep = 8
+    };
 
-    const QRegExp shortOption("-(\\w)");
+    enum Motion {MotionNone, MotionLeft, MotionRight, MotionZoomIn, MotionZoomOut};
+
+    // The last rendered frame and the recent frame times for the HUD.
+    // Always kept, a few additions per frame.
+    struct Frames
+    {
+        enum {History = 120};
+        DrawChannel::Counts counts;
+        qint64 ns;
+        qint64 hits;
+        qint64 misses;
+        std::vector<float> ms;
+        size_t next;
+
+        Frames():
+            counts(),
+            ns(0),
+            hits(0),
+            misses(0),
+            ms(History, 0),
+            next(0)
+        {
+        }
 
-    if (shortOption.exactMatch(line))
+        void add(const DrawChannel::Counts & frame, qint64 nanoseconds, qint64 cacheHits, qint64 cacheMisses)
+        {
+            counts = frame;
+            ns = nanoseconds;
+            hits = cacheHits;
+            misses = cacheMisses;
+            ms[next] = static_cast<float>(nanoseconds / 1e6);
+            next = (next + 1) % ms.size();
+        }
+    };
+
+    struct Prefetch
     {
-        std::cout << "Unknown option: " << shortOption.cap(0).toStdString() << std::endl;
-        mIsInvalid = true;
-        return;
-    }
+        struct Frame {UnitScale time; UnitScale value; QImage image;};
+        QMutex mutex;
+        std::vector<Frame> frames;
+        std::atomic<bool> isCanceled;
 
-    // assume filename argument
-    mFiles.push_back(line);
-}
+        Prefetch():
+            mutex(),
+            frames(),
+            isCanceled(false)
+        {
+        }
 
-void ArgumentParser::PrintUsage()
-{
-    std::stringstream ss;
-    ss << "Usage:" << std::endl;
-    ss << "  " << mApplication.toStdString() << " [options] [file]" << std::endl;
-    ss << "Options:" << std::endl;
-    ss << "  -t --test   ... execute unit tests" << std::endl;
-    ss << "  -h --help   ... show this help" << std::endl;
-    std::cout << ss.str();
-}
+        void run(const DataChannel & data, const std::vector<UnitScale> & targets,
+                const UnitScale & value, const QSize & size, int dpr, const QFont & font)
+        {
+            const QRect rect(QPoint(0, 0), size / dpr);
 
-////////////////////////////////////////////////////////////////////////////////
-// new gui
-////////////////////////////////////////////////////////////////////////////////
+            for (auto & time:targets)
+            {
+                if (!decode(data, time, value, rect.width())) return;
+                QImage image(size, QImage::Format_ARGB32_Premultiplied);
+                image.setDevicePixelRatio(dpr);
+                DrawChannel(image, font, rect, data, time, value);
+                QMutexLocker lock(&mutex);
+                frames.push_back(Frame{time, value, image});
+            }
+        }
 
-class GuiWave : public QWidget
-{
-    Q_OBJECT
-public:
-    explicit GuiWave(QWidget * parent, const DataChannel & data, double seconds):
-        QWidget(parent),
-        mData(data),
-        mResizeCounter(0),
-        mTimeScale(25.0, "s"),
-        mValueScale(10.0, data.unit())
-    {
-        qDebug() << "GuiWave::ctor";
-        mTimeScale.setXResolution();
-        mTimeScale.setPixelSize(width());
-        mTimeScale.autoZoom(0, seconds);
-        
-        mValueScale.setYResolution();
-        mValueScale.setPixelSize(height());
-        yzoomAuto();
+        // the blocks the view shows, one at a time until canceled
+        bool decode(const DataChannel & data, const UnitScale & time, const UnitScale & value, int width)
+        {
+            for (auto & file:data.files())
+            {
+                Translate t(time, value);
+                t.setData(file);
+                const qint64 begin = file.clipIndex(t.xpxToSampleIndex(0));
+                const qint64 end = file.clipIndex(t.xpxToSampleIndex(width) + 1) + 1;
+
+                for (qint64 index = begin; index < end;)
+                {
+                    if (isCanceled) return false;
+                    const qint64 next = ((index >> SampleStore::BlockShift) + 1) << SampleStore::BlockShift;
+                    file.lsbStats(index, std::min(end, next));
+                    index = next;
+                }
+            }
 
-        setFocusPolicy(Qt::StrongFocus);
-    }
+            return !isCanceled;
+        }
+    };
 
-    QString FormatValue(double value) const
+    const DataChannel & mData;
+    int mResizeCounter;
+    UnitScale mTimeScale;
+    UnitScale mValueScale;
+    QTimer mRefineTimer;
+    QTimer mPrefetchTimer;
+    bool mIsInteractive;
+    int mPixelStep;
+    QImage mBacking;
+    QRegion mDirty;
+    int mPendingScroll;
+    bool mPendingRedraw;
+    Motion mMotion;
+    std::shared_ptr<Prefetch> mPrefetch;
+    QFuture<void> mPrefetchDone;
+    Frames mFrames;
+
+    static QThreadPool & PrefetchPool()
     {
-        QString result;
-        QTextStream ss(&result);
-        ss << value << mValueScale.unit();
-        return result;
+        // one thread: prefetching never takes more than one core
+        static QThreadPool & pool = Trace::Instance().newPool(1);
+        return pool;
     }
 
-    TimeValueStrings focusStrings() const
+    // real input: the recent direction, prefetching stops at once
+    void track(Motion motion)
     {
-        TimeValueStrings p;
-        p.time = FormatTime(mTimeScale.focus());
-        p.value = FormatValue(mValueScale.focus());
-        p.mode = TimeValueStrings::Position;
-        return p;
+        mMotion = motion;
+        interrupt();
     }
 
-    TimeValueStrings measureStrings(QWidget * ptr) const
+    void interrupt()
     {
-        TimeValueStrings p;
-        p.time = FormatTime(mTimeScale.pixelToUnit(ptr->width()));
-        p.value = FormatValue(mValueScale.pixelToUnit(ptr->height()));
-        p.mode = TimeValueStrings::Measure;
-        return p;
+        mPrefetchTimer.stop();
+        if (mPrefetch) {mPrefetch->isCanceled = true;}
     }
 
-    QString zoomString() const
+    // the time scales after the next steps in the recent direction,
+    // both scroll directions without any
+    std::vector<UnitScale> prefetchTargets() const
     {
-        QString result;
-        QTextStream s(&result);
-        s << "zoom = ";
-        s << mTimeScale.mmPerUnit() << "mm/" << mTimeScale.unit() << ", ";
-        s << mValueScale.mmPerUnit() << "mm/" << mValueScale.unit();
+        std::vector<UnitScale> result;
+        UnitScale next(mTimeScale);
+
+        for (int step = 0; step < PrefetchSteps; ++step)
+        {
+            switch (mMotion)
+            {
+            case MotionNone:
+            case MotionRight:   next.scrollRight(); break;
+            case MotionLeft:    next.scrollLeft();  break;
+            case MotionZoomIn:  next.zoomIn();      break;
+            case MotionZoomOut: next.zoomOut();     break;
+            }
+
+            result.push_back(next);
+        }
+
+        if (mMotion == MotionNone)
+        {
+            UnitScale previous(mTimeScale);
+            previous.scrollLeft();
+            result.push_back(previous);
+        }
+
         return result;
     }
 
-    QString timeString() const
+    // shows a prefetched image of the current scales instead of rendering
+    bool usePrefetched()
     {
-        QString result;
-        QTextStream s(&result);
+        if (!mPrefetch) return false;
+        QMutexLocker lock(&mPrefetch->mutex);
 
-        if (mData.files().size() > 0)
+        for (auto & frame:mPrefetch->frames)
         {
-            const DataFile & file = mData.files()[0];
-            s << "data = " << FormatTime(file.duration()) << ", ";
+            if (!frame.time.isSameView(mTimeScale)) continue;
+            if (!frame.value.isSameView(mValueScale)) continue;
+            if (frame.image.size() != size() * devicePixelRatio()) continue;
+            mBacking = frame.image;
+            mDirty = QRegion();
+            mIsInteractive = false;
+            mRefineTimer.stop();
+            update();
+            return true;
         }
 
-        s << "visible = {" << FormatTime(mTimeScale.min());
-        s << ", " << FormatTime(mTimeScale.max()) << "}";
-        return result;
+        return false;
     }
 
-    QString valueString() const
+    void interact()
     {
-        QString result;
-        QTextStream s(&result);
-        s << "visible = {" << FormatValue(mValueScale.min());
-        s << ", " << FormatValue(mValueScale.max()) << "}";
-        return result;
+        startInteraction();
+        redraw();
     }
 
-    void setXFocus(int xpx)
+    void startInteraction()
     {
-        mTimeScale.setFocusPixel(xpx);
+        // continuous input (key repeat, resizing): render fast until idle
+        mIsInteractive = true;
+        mRefineTimer.start();
     }
 
-    void setYFocus(int ypx)
+    void scrollPixel(int px)
     {
-        const Translate t(mTimeScale, mValueScale);
-        mValueScale.setFocus(t.ypxToUnit(ypx));
+        // The view moved px pixels to the right: shift the rendered waves
+        // px pixels to the left and render only the newly exposed strip.
+        startInteraction();
+        const int dx = -px;
+
+        if ((dx == 0) || (std::abs(dx) >= width()) || mBacking.isNull())
+        {
+            redraw();
+            return;
+        }
+
+        const int dpr = static_cast<int>(mBacking.devicePixelRatio());
+        const int bytes = 4 * std::abs(dx) * dpr;
+        const int keep = mBacking.bytesPerLine() - bytes;
+
+        for (int y = 0; y < mBacking.height(); ++y)
+        {
+            uchar * line = mBacking.scanLine(y);
+            if (dx < 0) {memmove(line, line + bytes, keep);}
+            else        {memmove(line + bytes, line, keep);}
+        }
+
+        const QRegion fixed = DrawChannel::FixedRegion(*this, mData, mTimeScale, mValueScale);
+        const QRect exposed = (dx < 0)
+            ? QRect(width() + dx, 0, -dx, height())
+            : QRect(0, 0, dx, height());
+        mDirty += exposed;
+        mDirty += fixed;
+        mDirty += fixed.translated(dx, 0);
+
+        // the labels stack from another start now
+        UnitScale before(mTimeScale);
+        before.scroll(-px / mTimeScale.pixelPerUnit());
+        if (DrawChannel::LabelStart(before) != DrawChannel::LabelStart(mTimeScale)) {mDirty = rect();}
+        update();
     }
 
-    void yzoomAuto()
+    void renderBacking()
     {
-        bool first = true;
-        double min = 0;
-        double max = 0;
-        for (auto & data:mData.files())
+        // interactive frames use plain pixels on HiDPI screens
+        const int dpr = mIsInteractive ? 1 : devicePixelRatio();
+        const QSize size = this->size() * dpr;
+
+        if ((mBacking.size() != size) || (mBacking.devicePixelRatio() != dpr))
         {
-            Translate t(mTimeScale, mValueScale);
-            t.setData(data);
-            auto indexBegin = t.xpxToSampleIndex(0);
-            auto indexEnd = t.xpxToSampleIndex(width());
-            auto mm = data.minmax(indexBegin, indexEnd);
+            mBacking = QImage(size, QImage::Format_ARGB32_Premultiplied);
+            mBacking.setDevicePixelRatio(dpr);
+            mDirty = rect();
+        }
 
-            if (first)
-            {
-                first = false;
-                min = mm.min;
-                max = mm.max;
-                continue;
-            }
+        if (mDirty.isEmpty()) return;
+        QElapsedTimer timer;
+        timer.start();
+        const qint64 hits = BlockCache::Instance().hits();
+        const qint64 misses = BlockCache::Instance().misses();
+        DrawChannel::Counts counts;
 
-            if (min > mm.min) min = mm.min;
-            if (max < mm.max) max = mm.max;
+        for (auto & dirty:mDirty.rects())
+        {
+            const DrawChannel::Quality quality = mIsInteractive ? DrawChannel::Interactive : DrawChannel::Full;
+            const DrawChannel draw(mBacking, font(), dirty, mData, mTimeScale, mValueScale, quality, mPixelStep);
+            counts.add(draw.counts());
         }
 
-        mValueScale.autoZoom(min, max);
-        update();
+        mDirty = QRegion();
+        mFrames.add(counts, timer.nsecsElapsed(),
+                BlockCache::Instance().hits() - hits, BlockCache::Instance().misses() - misses);
+        if (mIsInteractive) {adaptPixelStep(timer.elapsed());}
+    }
+
+    void paintHud(QPainter & painter) const
+    {
+        // numbers of the last frame, frame times below (oldest left)
+        enum {Margin = 4, GraphHeight = 40, BudgetMs = FrameBudgetMs};
+        const DrawChannel::Counts & c = mFrames.counts;
+        const qint64 lookups = mFrames.hits + mFrames.misses;
+        QStringList lines;
+        lines << QString("paint %1 ms %2").arg(mFrames.ns / 1e6, 0, 'f', 1)
+            .arg(mIsInteractive ? QString("interactive step %1").arg(mPixelStep) : QString("full"));
+        lines << QString("samples %1 primitives %2").arg(c.samples).arg(c.primitives);
+        lines << QString("spp %1 %2").arg(c.samplesPerPixel, 0, 'g', 3).arg(c.path);
+        lines << QString("annotations %1").arg(c.annotations);
+        lines << QString("cache %1% of %2 blocks")
+            .arg(lookups ? (100.0 * mFrames.hits / lookups) : 100.0, 0, 'f', 1).arg(lookups);
+
+        const QFontMetrics fm = painter.fontMetrics();
+        int textWidth = 0;
+        for (auto & line:lines) {textWidth = std::max(textWidth, fm.width(line));}
+        const int w = std::max(textWidth, static_cast<int>(Frames::History)) + 2 * Margin;
+        const int h = lines.size() * fm.height() + GraphHeight + 3 * Margin;
+        const QRect box(width() - w - Margin, Margin, w, h);
+        painter.fillRect(box, QColor(0, 0, 0, 160));
+        painter.setPen(Qt::white);
+
+        for (int index = 0; index < lines.size(); ++index)
+        {
+            painter.drawText(box.left() + Margin, box.top() + Margin + index * fm.height() + fm.ascent(), lines[index]);
+        }
+
+        // twice the budget is full scale, the budget line in the middle
+        const int bottom = box.bottom() - Margin;
+        const int left = box.left() + Margin;
+        const double scale = static_cast<double>(GraphHeight) / (2 * BudgetMs);
+        painter.setPen(Qt::darkGray);
+        painter.drawLine(left, bottom - GraphHeight / 2, left + Frames::History - 1, bottom - GraphHeight / 2);
+
+        for (size_t index = 0; index < mFrames.ms.size(); ++index)
+        {
+            const float ms = mFrames.ms[(mFrames.next + index) % mFrames.ms.size()];
+            if (ms <= 0) continue;
+            const int bar = std::min(static_cast<int>(GraphHeight), static_cast<int>(ms * scale) + 1);
+            const int x = left + static_cast<int>(index);
+            painter.setPen((ms > BudgetMs) ? Qt::red : Qt::green);
+            painter.drawLine(x, bottom, x, bottom - bar + 1);
+        }
     }
 
-    void xzoomIn()  {mTimeScale.zoomIn(); update();}
-    void xzoomOut() {mTimeScale.zoomOut(); update();}
-    void yzoomIn()  {mValueScale.zoomIn(); update();}
-    void yzoomOut() {mValueScale.zoomOut(); update();}
-    void left()     {mTimeScale.scrollLeft(); update();}
-    void right()    {mTimeScale.scrollRight(); update();}
-    void down()     {mValueScale.scrollLeft(); update();}
-    void up()       {mValueScale.scrollRight(); update();}
-signals:
-    void signalClicked(GuiWave *, QMouseEvent *);
-    void signalSelected(GuiWave *);
-private:
-    const DataChannel & mData;
-    int mResizeCounter;
-    UnitScale mTimeScale;
-    UnitScale mValueScale;
+    void adaptPixelStep(qint64 elapsed)
+    {
+        // keep interactive frames within budget by coarsening the columns
+        if ((elapsed > FrameBudgetMs) && (mPixelStep < MaxPixelStep))
+        {
+            mPixelStep *= 2;
+        }
+        else if ((elapsed < (FrameBudgetMs / 4)) && (mPixelStep > 1))
+        {
+            mPixelStep /= 2;
+        }
+    }
 
     void paintEvent(QPaintEvent * e) override
     {
-        DrawChannel(*this, e->rect(), mData, mTimeScale, mValueScale);
+        // Only dirty parts of the backing image are rendered. Exposing
+        // pixels (e.g. by moving the GuiMeasure overlay) is a plain copy.
+        renderBacking();
+        QPainter painter(this);
+        painter.setClipRegion(e->region());
+        painter.drawImage(QPoint(0, 0), mBacking);
+        if (GlobalSetup::Instance().hud()) {paintHud(painter);}
+    }
+
+    void changeEvent(QEvent * e) override
+    {
+        if (e->type() == QEvent::FontChange) {redraw();}
+        QWidget::changeEvent(e);
     }
 
     void mousePressEvent(QMouseEvent * evt) override
@@ -1833,9 +7065,10 @@ private:
 
     void resizeEvent(QResizeEvent *) override
     {
-        mValueScale.setPixelSize(height());
-        mTimeScale.setPixelSize(width());
-        update();
+        // a new size fits the data again, a shared scale is kept
+        if (mValueScale.pixelSize() != height()) {mValueScale.setPixelSize(height());}
+        if (mTimeScale.pixelSize() != width()) {mTimeScale.setPixelSize(width());}
+        interact();
     }
     
     void focusInEvent(QFocusEvent *) override
@@ -1848,12 +7081,52 @@ class GuiMain : public QWidget
 {
     Q_OBJECT
 private:
+    enum Status
+    {
+        StatusNone,
+        StatusFocus,
+        StatusStats,
+        StatusMeasure,
+        StatusTime,
+        StatusValue,
+        StatusZoom
+    };
+
+    enum {FrameMs = 16, RowSpacing = 4};
+
+    // Only the rows in view have a GuiWave (mChannels, in channel order).
+    // Rows scrolled out keep their value scale, all share the time scale.
     const DataMain & mData;
     QStatusBar * mStatus;
     GuiMeasure * mMeasure;
     GuiWave * mSelected;
     std::vector<GuiWave *> mChannels;
+    std::map<size_t, UnitScale> mValueScales;
+    QScrollBar * mScroll;
+    QTimer mFrameTimer;
+    Status mPendingStatus;
+    Second mMatch;
+    bool mHasMatch;
 private slots:
+    void slotFrame()
+    {
+        // render only the final state of all input since the last frame
+        for (auto & chan:mChannels) {chan->applyPending();}
+        const Status status = mPendingStatus;
+        mPendingStatus = StatusNone;
+
+        switch (status)
+        {
+        case StatusNone:                    break;
+        case StatusFocus:   statusFocus();  break;
+        case StatusStats:   statusStats();  break;
+        case StatusMeasure: statusMeasure();break;
+        case StatusTime:    statusTime();   break;
+        case StatusValue:   statusValue();  break;
+        case StatusZoom:    statusZoom();   break;
+        }
+    }
+
     void slotWaveSelected(GuiWave * sender)
     {
         setMeasuredWave(sender);
@@ -1872,13 +7145,25 @@ private slots:
     void slotMeasureResized()
     {
         setFocus();
-        statusMeasure();
+        schedule(StatusMeasure);
     }
 
     void slotMeasureMoved()
     {
         setFocus();
-        statusFocus();
+        schedule(StatusStats);
+    }
+
+    void slotMeasureDragged()
+    {
+        // live while dragging: limited to one update per frame
+        setFocus();
+        schedule(StatusStats);
+    }
+
+    void slotRows()
+    {
+        layoutRows();
     }
 public:
     GuiMain(QMainWindow * parent, const DataMain & data):
@@ -1887,50 +7172,205 @@ public:
         mStatus(parent->statusBar()),
         mMeasure(nullptr),
         mSelected(nullptr),
-        mChannels()
+        mChannels(),
+        mValueScales(),
+        mScroll(new QScrollBar(Qt::Vertical, this)),
+        mFrameTimer(),
+        mPendingStatus(StatusNone),
+        mMatch(0),
+        mHasMatch(false)
+    {
+        mFrameTimer.setSingleShot(true);
+        mFrameTimer.setTimerType(Qt::PreciseTimer);
+        mFrameTimer.setInterval(FrameMs);
+        connect(&mFrameTimer, SIGNAL(timeout()), this, SLOT(slotFrame()));
+        connect(mScroll, SIGNAL(valueChanged(int)), this, SLOT(slotRows()));
+        layoutRows();
+    }
+
+    void refresh()
+    {
+        for (auto & chan:mChannels) {chan->redraw();}
+        statusFocus();
+    }
+
+    // The channels whose annotations can change now: no prefetch task of
+    // their row reads them. The others are collected on a later tick.
+    std::vector<size_t> withoutPrefetch(const std::vector<size_t> & channels) const
+    {
+        std::vector<size_t> result;
+
+        for (auto index:channels)
+        {
+            auto isBusy = [this, index](const GuiWave * wave) {return (channelIndex(wave) == index) && wave->isPrefetching();};
+            if (std::none_of(mChannels.begin(), mChannels.end(), isBusy)) {result.push_back(index);}
+        }
+
+        return result;
+    }
+
+    // new annotations: only rows showing them render again
+    void refresh(const std::vector<DataMain::Collected> & collected)
+    {
+        if (collected.empty()) return;
+
+        for (auto & wave:mChannels)
+        {
+            for (auto & added:collected)
+            {
+                if (added.channel == channelIndex(wave)) {wave->annotationsAdded(added.first, added.last);}
+            }
+        }
+
+        statusFocus();
+    }
+
+    void showStatus(const QString & msg)
+    {
+        if (mStatus) {mStatus->showMessage(msg);}
+    }
+
+    void xzoomIn()  {for (auto & chan:mChannels) {chan->xzoomIn(); }; schedule(StatusZoom);}
+    void xzoomOut() {for (auto & chan:mChannels) {chan->xzoomOut();}; schedule(StatusZoom);}
+    void left()     {for (auto & chan:mChannels) {chan->left();    }; schedule(StatusTime);}
+    void right()    {for (auto & chan:mChannels) {chan->right();   }; schedule(StatusTime);}
+    void yzoomIn()  {if (mSelected) {mSelected->yzoomIn();  }; schedule(StatusZoom);}
+    void yzoomOut() {if (mSelected) {mSelected->yzoomOut(); }; schedule(StatusZoom);}
+    void up()       {if (mSelected) {mSelected->up();       }; schedule(StatusValue);}
+    void down()     {if (mSelected) {mSelected->down();     }; schedule(StatusValue);}
+    void yzoomAuto(){if (mSelected) {mSelected->yzoomAuto();}; schedule(StatusZoom);}
+    void yzoomAutoAll()
+    {
+        // rows out of view zoom when they appear again
+        mValueScales.clear();
+        for (auto & chan:mChannels) {chan->yzoomAuto();}
+        schedule(StatusZoom);
+    }
+
+    enum Search {SearchFirst, SearchNext, SearchPrevious};
+
+    // Centers all channels at a matching annotation, starting at the last
+    // match if the view has not moved away from it. Wraps around.
+    void search(const QString & pattern, bool isRegex, Search mode)
+    {
+        if (!mSelected) return;
+        const AnnotationIndex::Matches & matches = mData.annotationIndex().find(pattern, isRegex);
+        const qint64 count = AnnotationIndex::count(matches);
+
+        if (count < 1)
+        {
+            mHasMatch = false;
+            showStatus(QString("search: no match for '%1'").arg(pattern));
+            return;
+        }
+
+        const Second from = searchOrigin();
+        Second found = 0;
+        bool isFound = false;
+        QString wrapped;
+
+        switch (mode)
+        {
+        case SearchFirst:    isFound = AnnotationIndex::first(matches, from, found);    break;
+        case SearchNext:     isFound = AnnotationIndex::next(matches, from, found);     break;
+        case SearchPrevious: isFound = AnnotationIndex::previous(matches, from, found); break;
+        }
+
+        if (!isFound)
+        {
+            const Second infinity = std::numeric_limits<Second>::infinity();
+
+            if (mode == SearchPrevious)
+            {
+                AnnotationIndex::previous(matches, infinity, found);
+                wrapped = ", continued at the end";
+            }
+            else
+            {
+                AnnotationIndex::first(matches, -infinity, found);
+                wrapped = ", continued at the start";
+            }
+        }
+
+        showMatch(found);
+        showStatus(QString("search: %1 matches for '%2' at %3%4")
+                .arg(count).arg(pattern).arg(FormatTime(found)).arg(wrapped));
+    }
+
+    // jumps to the next (or previous) sample of the selected channel
+    void findSample(GuiWave::Find find, bool isForward)
+    {
+        if (!mSelected || !mMeasure) return;
+        const char * names[] = {"crossing", "excursion", "peak"};
+        Second found = 0;
+
+        if (!mSelected->findSample(mMeasure, find, isForward, searchOrigin(), found))
+        {
+            showStatus(QString("%1: not found").arg(names[find]));
+            return;
+        }
+
+        showMatch(found);
+        showStatus(QString("%1 at %2").arg(names[find]).arg(FormatTime(found)));
+    }
+
+    // scrolls the channel rows, not the time
+    void pageUp()   {mScroll->triggerAction(QAbstractSlider::SliderPageStepSub);}
+    void pageDown() {mScroll->triggerAction(QAbstractSlider::SliderPageStepAdd);}
+
+    void rowHeight(int factor)
+    {
+        // at most one row fills the view
+        GlobalSetup & gs = GlobalSetup::Instance();
+        const qint64 wanted = (factor > 0) ? (static_cast<qint64>(gs.rowHeight()) * factor) : (gs.rowHeight() / -factor);
+        gs.setRowHeight(static_cast<int>(std::min<qint64>(std::max(1, height()), wanted)));
+        layoutRows();
+        showStatus(QString("row height = %1px").arg(gs.rowHeight()));
+    }
+
+    void measureLeft()  {mMeasure->deltaMove(-10, 0);}
+    void measureRight() {mMeasure->deltaMove( 10, 0);}
+    void measureUp()    {mMeasure->deltaMove(0, -10);}
+    void measureDown()  {mMeasure->deltaMove(0,  10);}
+private:
+    // the last match, if the focus has not been moved away from it
+    Second searchOrigin() const
     {
-        QVBoxLayout * layout = new QVBoxLayout(this);
-        for (auto & chan:mData.channels())
-        {
-            GuiWave * gui = new GuiWave(this, chan, data.duration());
-            layout->addWidget(gui);
-            mChannels.push_back(gui);
-            connect(gui, SIGNAL(signalClicked(GuiWave *, QMouseEvent *)),
-                    this, SLOT(slotWaveClicked(GuiWave *, QMouseEvent *)));
-            connect(gui, SIGNAL(signalSelected(GuiWave *)),
-                    this, SLOT(slotWaveSelected(GuiWave *)));
-        }
-        setLayout(layout);
-        if (mChannels.size() > 0) {slotWaveSelected(mChannels[0]);}
+        const Second focus = mSelected->focusTime();
+        const bool isAtMatch = mHasMatch && (std::abs(focus - mMatch) <= mSelected->secondsPerPixel());
+        return isAtMatch ? mMatch : focus;
     }
 
-    void refresh()
+    void showMatch(Second sec)
     {
-        update();
+        mMatch = sec;
+        mHasMatch = true;
+        for (auto & chan:mChannels) {chan->centerAt(sec);}
+
+        // the measure box follows the match
+        if (mMeasure && mSelected)
+        {
+            QRect geo = mMeasure->geometry();
+            geo.moveCenter(QPoint(mSelected->width() / 2, geo.center().y()));
+            mMeasure->setGeometry(geo);
+        }
+
+        setFocus();
+        schedule(StatusNone);
         statusFocus();
     }
 
-    void showStatus(const QString & msg)
+    void schedule(Status status)
     {
-        if (mStatus) {mStatus->showMessage(msg);}
-    }
+        // the latest request wins, but all of them update the focus
+        if ((status != StatusFocus) || (mPendingStatus == StatusNone))
+        {
+            mPendingStatus = status;
+        }
 
-    void xzoomIn()  {for (auto & chan:mChannels) {chan->xzoomIn(); }; statusZoom();}
-    void xzoomOut() {for (auto & chan:mChannels) {chan->xzoomOut();}; statusZoom();}
-    void left()     {for (auto & chan:mChannels) {chan->left();    }; statusTime();}
-    void right()    {for (auto & chan:mChannels) {chan->right();   }; statusTime();}
-    void yzoomIn()  {if (mSelected) {mSelected->yzoomIn();  }; statusZoom();}
-    void yzoomOut() {if (mSelected) {mSelected->yzoomOut(); }; statusZoom();}
-    void up()       {if (mSelected) {mSelected->up();       }; statusValue();}
-    void down()     {if (mSelected) {mSelected->down();     }; statusValue();}
-    void yzoomAuto(){if (mSelected) {mSelected->yzoomAuto();}; statusZoom();}
-    void yzoomAutoAll() {for (auto & chan:mChannels) {chan->yzoomAuto();}; statusZoom();}
+        if (!mFrameTimer.isActive()) {mFrameTimer.start();}
+    }
 
-    void measureLeft()  {mMeasure->deltaMove(-10, 0);}
-    void measureRight() {mMeasure->deltaMove( 10, 0);}
-    void measureUp()    {mMeasure->deltaMove(0, -10);}
-    void measureDown()  {mMeasure->deltaMove(0,  10);}
-private:
     void setFocus()
     {
         const QPoint focus = mMeasure->geometry().center();
@@ -1967,11 +7407,21 @@ private:
         }
     }
 
+    void statusStats()
+    {
+        statusFocus();
+        if (mSelected && mMeasure)
+        {
+            showStatus(mSelected->statsString(mMeasure));
+        }
+    }
+
     void statusMeasure()
     {
         if (mSelected && mMeasure)
         {
             mMeasure->setTimeValue(mSelected->measureStrings(mMeasure));
+            showStatus(mSelected->statsString(mMeasure));
         }
     }
 
@@ -2000,14 +7450,103 @@ private:
         gui->setMinimumSize(40, 40);
         gui->show();
         connect(gui, SIGNAL(signalMoved()), this, SLOT(slotMeasureMoved()));
+        connect(gui, SIGNAL(signalDragged()), this, SLOT(slotMeasureDragged()));
         connect(gui, SIGNAL(signalResized()), this, SLOT(slotMeasureResized()));
 
         mSelected = wave;
         mMeasure = gui;
     }
 
+    // Rows fill the height, but are at least rowHeight() high. Only rows
+    // in view get a GuiWave, it takes the scales of the others.
+    void layoutRows()
+    {
+        const int count = static_cast<int>(mData.channels().size());
+        const int h = std::max(1, height());
+        const int rowHeight = std::max(std::min(GlobalSetup::Instance().rowHeight(), h), h / std::max(1, count));
+        const qint64 total = static_cast<qint64>(rowHeight) * count;
+        const bool isScrolled = total > h;
+        const int w = width() - (isScrolled ? mScroll->sizeHint().width() : 0);
+
+        mScroll->blockSignals(true);
+        mScroll->setRange(0, static_cast<int>(std::min<qint64>(INT_MAX, std::max<qint64>(0, total - h))));
+        mScroll->setPageStep(h);
+        mScroll->setSingleStep(rowHeight);
+        mScroll->blockSignals(false);
+        mScroll->setGeometry(w, 0, width() - w, h);
+        mScroll->setVisible(isScrolled);
+
+        const int top = mScroll->value();
+        const size_t first = static_cast<size_t>(top / rowHeight);
+        const size_t last = std::min(static_cast<size_t>(count),
+                static_cast<size_t>((top + h + rowHeight - 1) / rowHeight));
+        std::vector<GuiWave *> rows;
+
+        for (size_t index = first; index < last; ++index)
+        {
+            GuiWave * wave = row(index);
+            wave->setGeometry(0, static_cast<int>(index) * rowHeight - top, w, rowHeight - RowSpacing);
+            rows.push_back(wave);
+        }
+
+        for (auto & wave:mChannels)
+        {
+            if (std::find(rows.begin(), rows.end(), wave) != rows.end()) continue;
+
+            if (wave == mSelected)
+            {
+                // the measure box moves to a row in view or goes with the wave
+                setMeasuredWave(rows.empty() ? nullptr : rows[0]);
+                if (wave == mSelected) {mSelected = nullptr; mMeasure = nullptr;}
+            }
+
+            // its prefetch task is canceled and reads only the channel
+            mValueScales.erase(channelIndex(wave));
+            mValueScales.insert(std::make_pair(channelIndex(wave), wave->valueScale()));
+            wave->cancelPrefetch();
+            wave->hide();
+            wave->deleteLater();
+        }
+
+        mChannels.swap(rows);
+        if (!mSelected && !mChannels.empty()) {slotWaveSelected(mChannels[0]);}
+    }
+
+    size_t channelIndex(const GuiWave * wave) const
+    {
+        return static_cast<size_t>(&wave->channel() - &mData.channels()[0]);
+    }
+
+    // the GuiWave of a channel, a new one if it is not in view yet
+    GuiWave * row(size_t index)
+    {
+        for (auto & wave:mChannels)
+        {
+            if (channelIndex(wave) == index) return wave;
+        }
+
+        const UnitScale * time = mChannels.empty() ? nullptr : &mChannels[0]->timeScale();
+        auto value = mValueScales.find(index);
+        GuiWave * wave = new GuiWave(this, mData.channels()[index], mData.duration(),
+                time, (value == mValueScales.end()) ? nullptr : &value->second);
+        connect(wave, SIGNAL(signalClicked(GuiWave *, QMouseEvent *)),
+                this, SLOT(slotWaveClicked(GuiWave *, QMouseEvent *)));
+        connect(wave, SIGNAL(signalSelected(GuiWave *)),
+                this, SLOT(slotWaveSelected(GuiWave *)));
+        wave->show();
+        return wave;
+    }
+
+    void wheelEvent(QWheelEvent * e) override
+    {
+        // not used by the rows: scrolls through them
+        QApplication::sendEvent(mScroll, e);
+    }
+
     void resizeEvent(QResizeEvent *) override
     {
+        layoutRows();
+
         if (mMeasure && mSelected)
         {
             QRect geo;
@@ -2030,8 +7569,13 @@ class MainWindow : public QMainWindow
 {
     Q_OBJECT
 private:
+    enum {CollectMs = 250};
+
     DataMain * mData;
     GuiMain * mGui;
+    QTimer mCollectTimer;
+    QLineEdit * mSearch;
+    QCheckBox * mRegex;
 private slots:
     void Open()     {Open(QFileDialog::getOpenFileName(this, QString("Open"), QDir::currentPath()));}
     void Reload()   {Open(GlobalSetup::Instance().fileName());}
@@ -2046,10 +7590,28 @@ private slots:
     void right()    {if (mGui) {mGui->right();}}
     void up()       {if (mGui) {mGui->up();}}
     void down()     {if (mGui) {mGui->down();}}
+    void pageUp()   {if (mGui) {mGui->pageUp();}}
+    void pageDown() {if (mGui) {mGui->pageDown();}}
+    void rowsTaller()  {if (mGui) {mGui->rowHeight(2);}}
+    void rowsShorter() {if (mGui) {mGui->rowHeight(-2);}}
     void measureLeft()  {if (mGui) {mGui->measureLeft();}}
     void measureRight() {if (mGui) {mGui->measureRight();}}
     void measureUp()    {if (mGui) {mGui->measureUp();}}
     void measureDown()  {if (mGui) {mGui->measureDown();}}
+    void searchFirst()  {if (mGui) {mGui->search(mSearch->text(), mRegex->isChecked(), GuiMain::SearchFirst);}}
+    void searchNext()   {if (mGui) {mGui->search(mSearch->text(), mRegex->isChecked(), GuiMain::SearchNext);}}
+    void searchPrevious() {if (mGui) {mGui->search(mSearch->text(), mRegex->isChecked(), GuiMain::SearchPrevious);}}
+    void crossingNext()     {if (mGui) {mGui->findSample(GuiWave::FindCrossing, true);}}
+    void crossingPrevious() {if (mGui) {mGui->findSample(GuiWave::FindCrossing, false);}}
+    void excursionNext()    {if (mGui) {mGui->findSample(GuiWave::FindExcursion, true);}}
+    void excursionPrevious(){if (mGui) {mGui->findSample(GuiWave::FindExcursion, false);}}
+    void peakNext()         {if (mGui) {mGui->findSample(GuiWave::FindPeak, true);}}
+    void peakPrevious()     {if (mGui) {mGui->findSample(GuiWave::FindPeak, false);}}
+    void searchEdit()
+    {
+        mSearch->setFocus();
+        mSearch->selectAll();
+    }
     void toggleByteOrder()
     {
         if (!mGui) return;
@@ -2070,6 +7632,22 @@ private slots:
         GlobalSetup::Instance().setDebug(dbg);
         if (mGui) {mGui->showStatus(dbg ? "Debug:On" : "Debug:Off");}
     }
+    void toggleHud()
+    {
+        if (!mGui) return;
+        GlobalSetup & gs = GlobalSetup::Instance();
+        gs.setHud(!gs.hud());
+        mGui->update();
+        mGui->showStatus(gs.hud() ? "HUD:On" : "HUD:Off");
+    }
+    void toggleDensity()
+    {
+        if (!mGui) return;
+        GlobalSetup & gs = GlobalSetup::Instance();
+        gs.setDensity(!gs.density());
+        mGui->refresh();
+        mGui->showStatus(gs.density() ? "Density:On" : "Density:Off");
+    }
     void toggleTime()
     {
         if (!mGui) return;
@@ -2088,6 +7666,18 @@ private slots:
         mGui->setFont(useSmall ? small : normal);
         mGui->showStatus(useSmall ? "Font:Small" : "Font:Normal");
     }
+    void collect()
+    {
+        // annotations of background detections while they progress,
+        // without waiting for prefetch tasks reading them
+        if (!mData) return;
+        const bool isDetecting = mData->isDetecting();
+        std::vector<size_t> channels = mData->detected();
+        if (mGui) {channels = mGui->withoutPrefetch(channels);}
+        const std::vector<DataMain::Collected> collected = mData->collect(channels);
+        if (mGui) {mGui->refresh(collected);}
+        if (!isDetecting && mData->detected().empty()) {mCollectTimer.stop();}
+    }
     void vim()
     {
         const QString cmd = "gvim " + GlobalSetup::Instance().fileName();
@@ -2098,9 +7688,22 @@ private slots:
 public:
     MainWindow():
         mData(nullptr),
-        mGui(nullptr)
+        mGui(nullptr),
+        mCollectTimer(),
+        mSearch(new QLineEdit(this)),
+        mRegex(new QCheckBox("Regex", this))
     {
         GlobalSetup::Instance().setDefaultFont(this);
+        mCollectTimer.setInterval(CollectMs);
+        connect(&mCollectTimer, SIGNAL(timeout()), this, SLOT(collect()));
+
+        // incremental annotation search
+        mSearch->setPlaceholderText("search annotations");
+        statusBar()->addPermanentWidget(mSearch);
+        statusBar()->addPermanentWidget(mRegex);
+        connect(mSearch, SIGNAL(textEdited(const QString &)), this, SLOT(searchFirst()));
+        connect(mSearch, SIGNAL(returnPressed()), this, SLOT(searchNext()));
+        connect(mRegex, SIGNAL(toggled(bool)), this, SLOT(searchFirst()));
         setWindowTitle(QString("no"));
         resize(600, 300);
     
@@ -2131,24 +7734,43 @@ public:
         ACTION(viewMenu, "Right", right, Qt::Key_Right);
         ACTION(viewMenu, "Up", up, Qt::Key_Up);
         ACTION(viewMenu, "Down", down, Qt::Key_Down);
+        ACTION(viewMenu, "Page-Up", pageUp, Qt::Key_PageUp);
+        ACTION(viewMenu, "Page-Down", pageDown, Qt::Key_PageDown);
+        ACTION(viewMenu, "Rows-Taller", rowsTaller, Qt::Key_Plus);
+        ACTION(viewMenu, "Rows-Shorter", rowsShorter, Qt::Key_Minus);
         ACTION(viewMenu, "Measure-Left", measureLeft, Qt::Key_Left + Qt::SHIFT);
         ACTION(viewMenu, "Measure-Right", measureRight, Qt::Key_Right + Qt::SHIFT);
         ACTION(viewMenu, "Measure-Up", measureUp, Qt::Key_Up + Qt::SHIFT);
         ACTION(viewMenu, "Measure-Down", measureDown, Qt::Key_Down + Qt::SHIFT);
         ACTION(viewMenu, "Font", toggleFont, Qt::Key_F);
         ACTION(viewMenu, "Time", toggleTime, Qt::Key_T);
+        ACTION(viewMenu, "Density", toggleDensity, Qt::Key_I);
+        ACTION(viewMenu, "HUD", toggleHud, Qt::Key_H);
+
+        QMenu * searchMenu = menuBar()->addMenu(tr("&Search"));
+        ACTION(searchMenu, "Search", searchEdit, Qt::Key_Slash);
+        ACTION(searchMenu, "Next-Match", searchNext, Qt::Key_N);
+        ACTION(searchMenu, "Previous-Match", searchPrevious, Qt::Key_N + Qt::SHIFT);
+        ACTION(searchMenu, "Next-Crossing", crossingNext, Qt::Key_C);
+        ACTION(searchMenu, "Previous-Crossing", crossingPrevious, Qt::Key_C + Qt::SHIFT);
+        ACTION(searchMenu, "Next-Excursion", excursionNext, Qt::Key_E);
+        ACTION(searchMenu, "Previous-Excursion", excursionPrevious, Qt::Key_E + Qt::SHIFT);
+        ACTION(searchMenu, "Next-Peak", peakNext, Qt::Key_P);
+        ACTION(searchMenu, "Previous-Peak", peakPrevious, Qt::Key_P + Qt::SHIFT);
 #undef ACTION
     }
 
     ~MainWindow()
     {
         delete mGui;
+        GuiWave::WaitForPrefetch();
         delete mData;
     }
 
     void Open(QString name)
     {
         delete mGui;
+        GuiWave::WaitForPrefetch();
         delete mData;
         mGui = nullptr;
         mData = nullptr;
@@ -2157,6 +7779,7 @@ public:
         mGui = new GuiMain(this, *mData);
         setCentralWidget(mGui);
         setWindowTitle(name);
+        if (mData->isDetecting()) {mCollectTimer.start();}
         if (mData->valid()) return;
         QMessageBox::information(0, "Error", mData->error());
     }
@@ -2170,6 +7793,16 @@ public:
 
 int main(int argc, char * argv[])
 {
+    // headless modes need no display
+    for (int index = 1; index < argc; ++index)
+    {
+        const QString arg(argv[index]);
+        const bool isHeadless = arg.startsWith("--png=") || arg.startsWith("--export=") ||
+            arg.startsWith("--generate=") || arg.startsWith("--render-bench=") ||
+            (arg == "--stats") || (arg == "--bench");
+        if (isHeadless) {qputenv("QT_QPA_PLATFORM", "offscreen");}
+    }
+
     QApplication app(argc, argv);
     ArgumentParser arguments;
     arguments.ParseList(app.arguments());
@@ -2185,6 +7818,52 @@ int main(int argc, char * argv[])
         return 0;
     }
 
+    const Trace::Session trace(arguments.TraceFile());
+
+    if (arguments.CacheMb() > 0)
+    {
+        BlockCache::Instance().setBudget(static_cast<qint64>(arguments.CacheMb()) << 20);
+    }
+
+    if (arguments.RowHeight() > 0)
+    {
+        GlobalSetup::Instance().setRowHeight(arguments.RowHeight());
+    }
+
+    if (arguments.IsPng())
+    {
+        return Snapshot(arguments).run(arguments.Files());
+    }
+
+    if (arguments.IsExport())
+    {
+        return Export(arguments).run(arguments.Files());
+    }
+
+    if (arguments.IsStats())
+    {
+        return Report(arguments).run(arguments.Files());
+    }
+
+    if (!arguments.Generate().isEmpty())
+    {
+        const QString info = Generator(arguments.Generator()).write(arguments.Generate());
+        if (info.isEmpty()) {std::cerr << "cannot write " << arguments.Generate().toStdString() << std::endl;}
+        return info.isEmpty() ? 1 : 0;
+    }
+
+    if (!arguments.Golden().isEmpty())
+    {
+        return RenderBench(arguments).run();
+    }
+
+    if (arguments.IsBench())
+    {
+        if (arguments.Files().size() > 0) {return Benchmark().run(arguments.Files()[0]);}
+        QTemporaryDir dir;
+        return Benchmark().run(Generator(arguments.Generator()).write(dir.path()));
+    }
+
     MainWindow win;
     win.show();
 
@@ -2302,6 +7981,638 @@ TEST(DataFile, parse)
 
     DataFile d("dummy 100 x");
     EXPECT_FALSE(d.valid());
+
+    // only the first file of a channel is drawn as spectrogram
+    EXPECT_TRUE(DataFile("dummy 500 1 mV \"L\" spectrogram").valid());
+    EXPECT_FALSE(DataFile("+dummy 500 1 mV \"L\" spectrogram").valid());
+    EXPECT_FALSE(DataFile("-dummy 500 1 mV \"L\" spectrogram").valid());
+}
+
+TEST(RangeStats, query)
+{
+    std::vector<int> samples;
+    for (int index = 0; index < 1000; ++index)
+    {
+        samples.push_back(((index * 7919) % 201) - 100);
+    }
+
+    RangeStats stats(4);
+    stats.build(samples);
+
+    for (int begin = 0; begin < 1000; begin += 37)
+    {
+        for (int end = begin; end <= 1000; end += 53)
+        {
+            SampleStats expected;
+            expected.add(samples.data() + begin, end - begin);
+            const SampleStats actual = stats.query(samples.data(), begin, end);
+            EXPECT_EQ(expected.count, actual.count);
+            EXPECT_EQ(expected.min, actual.min);
+            EXPECT_EQ(expected.max, actual.max);
+            EXPECT_EQ(expected.sum, actual.sum);
+            EXPECT_TRUE(IsEqual(expected.squares, actual.squares));
+        }
+    }
+}
+
+TEST(FilterStore, notch)
+{
+    // 50Hz mains on top of an offset: both disappear
+    std::vector<int> samples;
+    for (int index = 0; index < 3 * SampleStore::BlockSize; ++index)
+    {
+        samples.push_back(1000 + static_cast<int>(500 * std::sin(2 * M_PI * 50 * index / 500.0)));
+    }
+
+    FilterSetup setup;
+    setup.highPass = 0.5;
+    setup.notch = 50;
+    auto raw = std::make_shared<MemoryStore>(std::move(samples));
+    FilterStore filtered(raw, setup, 500);
+    EXPECT_EQ(raw->size(), filtered.size());
+
+    const SampleStats stats = filtered.stats(1000, filtered.size() - 1000);
+    EXPECT_TRUE(std::abs(stats.mean()) < 5);
+    EXPECT_TRUE(stats.max < 25);
+    EXPECT_TRUE(stats.min > -25);
+
+    std::vector<int> window;
+    filtered.read(SampleStore::BlockSize - 10, SampleStore::BlockSize + 10, window);
+    EXPECT_EQ(20u, window.size());
+    EXPECT_EQ(window[10], filtered.at(SampleStore::BlockSize));
+}
+
+TEST(ResampleStore, sine)
+{
+    // 5Hz sine: 500sps -> 250sps -> 500sps with a quarter sample offset
+    std::vector<int> samples;
+    for (int index = 0; index < 5000; ++index)
+    {
+        samples.push_back(static_cast<int>(std::lround(1000 * std::sin(2 * M_PI * 5 * index / 500.0))));
+    }
+
+    auto raw = std::make_shared<MemoryStore>(std::move(samples));
+    auto half = std::make_shared<ResampleStore>(raw, 500, 0, 250, 0, 2500);
+    ResampleStore back(half, 250, 0, 500, 0.0005, 4990);
+
+    for (qint64 index = 100; index < 2400; index += 7)
+    {
+        EXPECT_TRUE(std::abs(half->at(index) - raw->at(2 * index)) <= 2);
+        const double expected = 1000 * std::sin(2 * M_PI * 5 * (index / 500.0 + 0.0005));
+        EXPECT_TRUE(std::abs(back.at(index) - expected) <= 3);
+    }
+
+    EXPECT_EQ(4990, back.size());
+}
+
+TEST(Fft, transform)
+{
+    Fft fft(60);
+    EXPECT_EQ(64, fft.size());
+
+    // sine with 5 periods: all power in bin 5 (and its mirror 59)
+    std::vector<std::complex<double>> data(64);
+    for (size_t index = 0; index < data.size(); ++index)
+    {
+        data[index] = std::sin(2 * M_PI * 5 * index / 64.0);
+    }
+
+    const std::vector<std::complex<double>> original = data;
+    fft.transform(data);
+
+    for (size_t bin = 0; bin < data.size(); ++bin)
+    {
+        const bool isPeak = ((bin == 5) || (bin == 59));
+        EXPECT_TRUE(IsEqual(std::abs(data[bin]), isPeak ? 32.0 : 0.0));
+    }
+
+    fft.transform(data, true);
+    for (size_t index = 0; index < data.size(); ++index)
+    {
+        EXPECT_TRUE(IsEqual(data[index].real(), original[index].real()));
+        EXPECT_TRUE(IsEqual(data[index].imag(), 0.0));
+    }
+}
+
+TEST(QrsDetector, synthetic)
+{
+    // 72bpm: R, S and T waves on baseline wander and 50Hz mains
+    const double sps = 500;
+    const double rr = 0.83;
+    std::vector<int> samples;
+    for (int index = 0; index < 30 * sps; ++index)
+    {
+        const double t = index / sps;
+        const double phase = std::fmod(t, rr);
+        auto wave = [phase](double center, double width) {return std::exp(-std::pow((phase - center) / width, 2) / 2);};
+        const double noise = 300 * std::sin(2 * M_PI * 0.3 * t) + 100 * std::sin(2 * M_PI * 50 * t);
+        samples.push_back(static_cast<int>(noise + 1000 * wave(0.4, 0.012) - 150 * wave(0.42, 0.01) + 250 * wave(0.65, 0.05)));
+    }
+
+    QrsDetector detector(sps);
+    std::vector<qint64> beats;
+    for (size_t begin = 0; begin < samples.size(); begin += 1000)
+    {
+        detector.feed(samples.data() + begin, 1000, beats);
+    }
+
+    detector.finish(beats);
+    EXPECT_EQ(static_cast<size_t>(std::ceil((30 - 0.4) / rr)), beats.size());
+
+    for (size_t index = 0; index < beats.size(); ++index)
+    {
+        const double expected = (0.4 + index * rr) * sps;
+        EXPECT_TRUE(std::abs(beats[index] - expected) <= 3);
+    }
+}
+
+TEST(AnnotationIndex, find)
+{
+    AnnotationIndex index;
+    index.add("R", 3.0);
+    index.add("V", 2.0);
+    index.add("R", 1.0);
+    index.add("Noise", 4.0);
+    index.add("R", 5.0);
+    index.done();
+
+    const AnnotationIndex::Matches beats = index.find("[rv]", true);
+    EXPECT_EQ(4u, beats.size());
+    EXPECT_EQ(4, AnnotationIndex::count(beats));
+    EXPECT_EQ(1, AnnotationIndex::count(index.find("noi", false)));
+    EXPECT_EQ(0, AnnotationIndex::count(index.find("[", true)));
+
+    Second found = 0;
+    EXPECT_TRUE(AnnotationIndex::first(beats, 2.0, found));
+    EXPECT_TRUE(IsEqual(2.0, found));
+    EXPECT_TRUE(AnnotationIndex::next(beats, 2.0, found));
+    EXPECT_TRUE(IsEqual(3.0, found));
+    EXPECT_TRUE(AnnotationIndex::next(beats, 3.0, found));
+    EXPECT_TRUE(IsEqual(5.0, found));
+    EXPECT_FALSE(AnnotationIndex::next(beats, 5.0, found));
+    EXPECT_TRUE(AnnotationIndex::previous(beats, 3.0, found));
+    EXPECT_TRUE(IsEqual(2.0, found));
+    EXPECT_FALSE(AnnotationIndex::previous(beats, 1.0, found));
+}
+
+TEST(AnnotationIndex, substrings)
+{
+    // free text and punctuation, case-insensitive substrings
+    AnnotationIndex index;
+    index.add("Atrial fibrillation onset", 1.0);
+    index.add("atrial flutter", 2.0);
+    index.add("Sinus rhythm (restored)", 3.0);
+    index.add("atrial flutter", 4.0);
+    index.add("!", 5.0);
+    index.add("+", 6.0);
+    index.done();
+
+    EXPECT_EQ(3, AnnotationIndex::count(index.find("atr", false)));
+    EXPECT_EQ(3, AnnotationIndex::count(index.find("ATRIAL F", false)));
+    EXPECT_EQ(2, AnnotationIndex::count(index.find("atrial fl", false)));
+    EXPECT_EQ(1, AnnotationIndex::count(index.find("(restored", false)));
+    EXPECT_EQ(1, AnnotationIndex::count(index.find("brill", false)));
+    EXPECT_EQ(1, AnnotationIndex::count(index.find("brill", true)));
+    EXPECT_EQ(0, AnnotationIndex::count(index.find("onset atrial", false)));
+    EXPECT_EQ(1, AnnotationIndex::count(index.find("!", false)));
+    EXPECT_EQ(1, AnnotationIndex::count(index.find("+", false)));
+    EXPECT_EQ(0, AnnotationIndex::count(index.find("+", true)));
+
+    // merged over the matching texts
+    const AnnotationIndex::Matches matches = index.find("t", false);
+    EXPECT_EQ(4u, matches.size());
+    EXPECT_TRUE(std::is_sorted(matches.begin(), matches.end()));
+}
+
+TEST(SampleSearch, skip)
+{
+    // a flat line over many blocks with an excursion at both ends
+    std::vector<int> samples(10 * SampleStore::BlockSize, 0);
+    samples[100] = -50;
+    samples[samples.size() - 100] = 50;
+    samples[samples.size() - 99] = 80;
+    samples[samples.size() - 98] = 30;
+    const qint64 last = static_cast<qint64>(samples.size()) - 98;
+    MemoryStore store(std::move(samples));
+    SampleSearch search(store);
+
+    EXPECT_EQ(100, search.outside(0, -10, 10, true));
+    EXPECT_EQ(last - 2, search.outside(101, -10, 10, true));
+    EXPECT_EQ(100, search.outside(last - 3, -10, 10, false));
+    EXPECT_EQ(-1, search.outside(101, -100, 100, true));
+    EXPECT_EQ(101, search.inside(100, -10, 10, true));
+    EXPECT_EQ(100, search.crossing(0, 0, true));
+    EXPECT_EQ(101, search.crossing(101, 0, true));
+    EXPECT_EQ(last - 2, search.crossing(last, 1, false));
+    EXPECT_EQ(100, search.peak(0, -10, 10, true));
+    EXPECT_EQ(last - 1, search.peak(100, -10, 10, true));
+    EXPECT_EQ(100, search.peak(last - 1, -10, 10, false));
+}
+
+TEST(ExpressionStore, leads)
+{
+    const Expression bad("I+*II");
+    EXPECT_FALSE(bad.valid());
+    EXPECT_FALSE(Expression("(I+II").valid());
+
+    const Expression mean("-(I - 'lead II') / 2 * 3e0");
+    EXPECT_TRUE(mean.valid());
+    EXPECT_EQ(2u, mean.names().size());
+    EXPECT_EQ("lead II", mean.names()[1]);
+    EXPECT_EQ(2, mean.depth());
+
+    std::vector<int> one;
+    std::vector<int> two;
+    for (int index = 0; index < SampleStore::BlockSize + 300; ++index)
+    {
+        one.push_back(index % 1000);
+        two.push_back(-2 * (index % 700));
+    }
+
+    auto a = std::make_shared<MemoryStore>(std::vector<int>(one));
+    auto b = std::make_shared<MemoryStore>(std::vector<int>(two));
+    ExpressionStore store({a, b}, {0.5, 0.25}, mean, 0.25, a->size());
+    EXPECT_EQ(a->size(), store.size());
+
+    for (qint64 index = 0; index < store.size(); index += 97)
+    {
+        const double expected = -(0.5 * one[index] - 0.25 * two[index]) / 2 * 3 / 0.25;
+        EXPECT_EQ(static_cast<int>(std::lround(expected)), store.at(index));
+    }
+
+    DataFile line("= \"(I+II)/2\" mV \"I+II\" hp=0.5");
+    EXPECT_TRUE(line.valid());
+    EXPECT_TRUE(line.isExpression());
+    EXPECT_TRUE(line.isFiltered());
+    EXPECT_EQ("mV", line.unit());
+    EXPECT_EQ("I+II", line.label());
+}
+
+TEST(ExpressionStore, operators)
+{
+    // the label of a "-" line is an operand
+    const ArgumentParser::Synthetic setup{2, 2, 500, 0, false, false};
+    QTemporaryDir dir;
+    EXPECT_FALSE(Generator(setup).write(dir.path()).isEmpty());
+    const QString name = dir.path() + "/minus.info";
+    QFile info(name);
+    EXPECT_TRUE(info.open(QIODevice::WriteOnly));
+    info.write("lead0.dat 500 1 mV \"L0\" gain=0.005\n");
+    info.write("-lead1.dat 500 1 mV \"L1\" gain=0.005\n");
+    info.write("= \"'L0-L1' * 2\" mV \"D\"\n");
+    info.close();
+
+    const DataMain data(name);
+    EXPECT_TRUE(data.valid());
+    EXPECT_EQ(2u, data.channels().size());
+    const DataFile & difference = data.channels()[0].files()[0];
+    const DataFile & twice = data.channels()[1].files()[0];
+    EXPECT_EQ(difference.sampleCount(), twice.sampleCount());
+
+    for (qint64 index = 0; index < twice.sampleCount(); index += 37)
+    {
+        EXPECT_EQ(2 * difference.lsb(index), twice.lsb(index));
+    }
+}
+
+TEST(Alignment, lag)
+{
+    // irregular beats: b is a 4321 samples earlier, with another baseline
+    std::vector<int> a(300000, 0);
+    std::vector<int> b(280000, 0);
+    unsigned seed = 1;
+
+    for (size_t r = 500; r + 20 < a.size(); r += 300 + (seed % 200))
+    {
+        seed = seed * 1103515245 + 12345;
+        for (size_t index = 0; index < 20; ++index) {a[r + index] = 1000 - 100 * static_cast<int>(index);}
+    }
+
+    for (size_t index = 0; index < b.size(); ++index)
+    {
+        b[index] = a[index + 4321] + static_cast<int>(index / 1000);
+    }
+
+    const MemoryStore storeA{std::vector<int>(a)};
+    const MemoryStore storeB{std::vector<int>(b)};
+    EXPECT_EQ(4321, Alignment::lag(storeA, storeB));
+    EXPECT_EQ(-4321, Alignment::lag(storeB, storeA));
+}
+
+TEST(PagedStore, interleave)
+{
+    // frames of 3 little endian words, the channel is the middle one
+    QTemporaryFile file;
+    EXPECT_TRUE(file.open());
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    const qint64 frames = SampleStore::BlockSize + 10;
+    for (qint64 frame = 0; frame < frames; ++frame) {out << qint16(7) << qint16(frame % 3000 - 1000) << qint16(-7);}
+    out << qint16(7);
+    file.close();
+
+    const SampleFormat format{true, false, 0xffff, 0, 3, 1, 1};
+    const PagedStore store(file.fileName(), format);
+    EXPECT_EQ(frames, store.size());
+    EXPECT_EQ(-1000, store.at(0));
+    EXPECT_EQ(static_cast<int>((frames - 1) % 3000 - 1000), store.at(frames - 1));
+
+    std::vector<int> samples;
+    store.read(SampleStore::BlockSize - 5, frames, samples);
+    EXPECT_EQ(15u, samples.size());
+    EXPECT_EQ(static_cast<int>((SampleStore::BlockSize - 5) % 3000 - 1000), samples[0]);
+    EXPECT_EQ(-1000, store.stats(0, frames).min);
+    EXPECT_EQ(1999, store.stats(0, frames).max);
+}
+
+TEST(Generator, info)
+{
+    // interleaved leads and one annotation every second
+    const ArgumentParser::Synthetic setup{3, 4, 250, 60, true, false};
+    QTemporaryDir dir;
+    const QString info = Generator(setup).write(dir.path());
+    EXPECT_FALSE(info.isEmpty());
+    const DataMain data(info);
+    EXPECT_TRUE(data.valid());
+    EXPECT_EQ(4u, data.channels().size());
+    EXPECT_EQ(750, data.channels()[3].files()[0].sampleCount());
+    EXPECT_EQ(3u, data.channels()[0].files()[0].annotations().size());
+}
+
+TEST(Generator, manyLeads)
+{
+    // the beats of the last lead stay in the int16 range
+    const ArgumentParser::Synthetic setup{1, 400, 250, 0, true, false};
+    QTemporaryDir dir;
+    const DataMain data(Generator(setup).write(dir.path()));
+    EXPECT_TRUE(data.valid());
+    const DataFile & first = data.channels()[0].files()[0];
+    const DataFile & last = data.channels()[399].files()[0];
+    const SampleStats firstStats = first.lsbStats(0, first.sampleCount());
+    const SampleStats lastStats = last.lsbStats(0, last.sampleCount());
+    EXPECT_TRUE(lastStats.max > firstStats.max);
+    EXPECT_TRUE(lastStats.min > -1000);
+}
+
+TEST(RenderBench, difference)
+{
+    QImage a(QSize(20, 10), QImage::Format_ARGB32_Premultiplied);
+    a.fill(Qt::white);
+    QImage b(a);
+    EXPECT_EQ(0, RenderBench::Difference(a, b));
+    b.setPixel(3, 4, qRgb(0, 0, 0));
+    b.setPixel(19, 9, qRgb(0, 0, 0));
+    QImage diff;
+    EXPECT_EQ(2, RenderBench::Difference(a, b, &diff));
+    EXPECT_EQ(qRgb(255, 0, 0), diff.pixel(3, 4));
+    EXPECT_EQ(qRgb(255, 255, 255), diff.pixel(0, 0));
+    EXPECT_EQ(-1, RenderBench::Difference(a, QImage(QSize(20, 11), QImage::Format_ARGB32)));
+}
+
+TEST(RenderBench, golden)
+{
+    // the same setup renders the same pixels every time
+    const ArgumentParser::Synthetic setup{4, 2, 250, 60, false, false};
+    QTemporaryDir dir;
+    const DataMain data(Generator(setup).write(dir.path() + "/data"));
+    EXPECT_TRUE(data.valid());
+    const std::vector<const DataChannel *> channels = {&data.channels()[0], &data.channels()[1]};
+    const QSize size(200, 100);
+    const QImage one = Snapshot::Image(channels, size, QApplication::font(), 0, 2);
+    const QImage two = Snapshot::Image(channels, size, QApplication::font(), 0, 2);
+    QImage white(size, QImage::Format_ARGB32_Premultiplied);
+    white.fill(Qt::white);
+    EXPECT_EQ(0, RenderBench::Difference(one, two));
+    EXPECT_TRUE(RenderBench::Difference(one, white) > 0);
+
+    // a missing golden image fails unless it is written
+    const QString golden = dir.path() + "/golden";
+    ArgumentParser check;
+    check.ParseList(QStringList() << "no" << ("--render-bench=" + golden) << "--size=200x100");
+    ArgumentParser update;
+    update.ParseList(QStringList() << "no" << ("--render-bench=" + golden) << "--size=200x100" << "--update-golden");
+    EXPECT_TRUE(QDir().mkpath(golden));
+    EXPECT_FALSE(RenderBench(check).measure("small", channels, 0, 2));
+    EXPECT_TRUE(RenderBench(update).measure("small", channels, 0, 2));
+    EXPECT_TRUE(QFileInfo(golden + "/small.png").exists());
+    EXPECT_TRUE(RenderBench(check).measure("small", channels, 0, 2));
+}
+
+TEST(Trace, json)
+{
+    QTemporaryDir dir;
+    const QString name = dir.path() + "/trace.json";
+    Trace & trace = Trace::Instance();
+    trace.start();
+    {TraceScope scope("test span");}
+    trace.add("test counter", 3);
+    trace.add("test counter", 4);
+    EXPECT_TRUE(trace.write(name).isEmpty());
+    EXPECT_FALSE(trace.isEnabled());
+
+    QFile file(name);
+    EXPECT_TRUE(file.open(QIODevice::ReadOnly));
+    QJsonParseError error;
+    const QJsonDocument json = QJsonDocument::fromJson(file.readAll(), &error);
+    EXPECT_EQ(QJsonParseError::NoError, error.error);
+    int spans = 0;
+    int total = 0;
+
+    for (auto value:json.object()["traceEvents"].toArray())
+    {
+        const QJsonObject event = value.toObject();
+        if (event["name"].toString() == "test span") {spans += (event["ph"].toString() == "X") ? 1 : 0;}
+        if (event["name"].toString() == "test counter") {total = event["args"].toObject()["value"].toInt();}
+    }
+
+    EXPECT_EQ(1, spans);
+    EXPECT_EQ(7, total);
+}
+
+TEST(Trace, totals)
+{
+    // the deltas of all threads add up, write() starts over
+    QTemporaryDir dir;
+    const QString name = dir.path() + "/trace.json";
+    Trace & trace = Trace::Instance();
+    std::vector<int> deltas;
+    for (int delta = 1; delta <= 100; ++delta) {deltas.push_back(delta);}
+
+    auto totals = [&name]()
+    {
+        QFile file(name);
+        std::vector<int> result;
+        if (!file.open(QIODevice::ReadOnly)) return result;
+
+        for (auto value:QJsonDocument::fromJson(file.readAll()).object()["traceEvents"].toArray())
+        {
+            const QJsonObject event = value.toObject();
+            if (event["name"].toString() == "test total") {result.push_back(event["args"].toObject()["value"].toInt());}
+        }
+
+        return result;
+    };
+
+    trace.start();
+    QtConcurrent::blockingMap(deltas, [&trace](int delta) {trace.add("test total", delta);});
+    EXPECT_TRUE(trace.write(name).isEmpty());
+    const std::vector<int> first = totals();
+    EXPECT_EQ(100u, first.size());
+    EXPECT_EQ(5050, first.empty() ? 0 : first.back());
+
+    trace.start();
+    EXPECT_TRUE(trace.write(name).isEmpty());
+    EXPECT_EQ(0u, totals().size());
+}
+
+TEST(Trace, stopped)
+{
+    // a span ending after write() is not part of the next trace
+    QTemporaryDir dir;
+    const QString name = dir.path() + "/trace.json";
+    Trace & trace = Trace::Instance();
+    trace.start();
+
+    {
+        TraceScope scope("test late span");
+        EXPECT_TRUE(trace.write(name).isEmpty());
+    }
+
+    trace.start();
+    EXPECT_TRUE(trace.write(name).isEmpty());
+    QFile file(name);
+    EXPECT_TRUE(file.open(QIODevice::ReadOnly));
+    EXPECT_FALSE(file.readAll().contains("test late span"));
+}
+
+TEST(DrawChannel, pixelWisePath)
+{
+    EXPECT_EQ("pixel-wise raw", DrawChannel::PixelWisePath(5.5));
+    EXPECT_EQ("pixel-wise raw", DrawChannel::PixelWisePath(63));
+    EXPECT_EQ("pixel-wise level 0", DrawChannel::PixelWisePath(64));
+    EXPECT_EQ("pixel-wise level 3", DrawChannel::PixelWisePath(600));
+    EXPECT_EQ("pixel-wise blocks", DrawChannel::PixelWisePath(SampleStore::BlockSize));
+}
+
+TEST(DrawChannel, labelStart)
+{
+    // a multiple of the view width, one or two widths left of the view
+    UnitScale x(25, "s");
+    x.setPixelPerMillimeter(40, 10);
+    x.setPixelSize(420);
+    x.autoZoom(0, 4);
+    EXPECT_TRUE(IsEqual(-8.4, DrawChannel::LabelStart(x)));
+    x.scroll(1.0);
+    EXPECT_TRUE(IsEqual(-4.2, DrawChannel::LabelStart(x)));
+    x.scroll(2.0);
+    EXPECT_TRUE(IsEqual(-4.2, DrawChannel::LabelStart(x)));
+    x.scroll(2.0);
+    EXPECT_TRUE(IsEqual(0.0, DrawChannel::LabelStart(x)));
+}
+
+TEST(Export, framing)
+{
+    const std::vector<Export::Column> columns = {
+        Export::Column{nullptr, 0.5, "I [mV]"}, Export::Column{nullptr, 2.0, "II [mV]"}};
+    const std::vector<std::vector<int>> samples = {{1, -40000}, {3, 70000}};
+    EXPECT_EQ(QByteArray("time [s],I [mV],II [mV]\n"), Export::CsvHeader(columns));
+
+    QByteArray csv;
+    Export::AppendCsv(columns, samples, 1.0, 250, csv);
+    EXPECT_EQ(QByteArray("1.000000,0.5,6\n1.004000,-20000,140000\n"), csv);
+
+    // frames of little endian float32 values
+    QByteArray f32;
+    Export::AppendBinary(columns, samples, true, f32);
+    EXPECT_EQ(16, f32.size());
+    EXPECT_EQ(QByteArray("\x00\x00\x00\x3f\x00\x00\xc0\x40", 8), f32.left(8));
+
+    // frames of little endian int16 lsb, clamped
+    QByteArray i16;
+    Export::AppendBinary(columns, samples, false, i16);
+    EXPECT_EQ(QByteArray("\x01\x00\x03\x00\x00\x80\xff\x7f", 8), i16);
+}
+
+TEST(UnitScale, sameView)
+{
+    // a prefetched view matches the view after the same input
+    UnitScale x(25, "s");
+    x.setPixelPerMillimeter(40, 10);
+    x.setPixelSize(420);
+    x.autoZoom(0, 4);
+    UnitScale next(x);
+    next.scrollRight();
+    next.scrollRight();
+    EXPECT_FALSE(next.isSameView(x));
+    x.scrollRight();
+    x.scrollRight();
+    EXPECT_TRUE(next.isSameView(x));
+    next.zoomIn();
+    EXPECT_FALSE(next.isSameView(x));
+    x.zoomIn();
+    EXPECT_TRUE(next.isSameView(x));
+}
+
+TEST(UnitScale, fit)
+{
+    UnitScale x(25, "s");
+    x.setPixelSize(1600);
+    x.fit(10, 13);
+    EXPECT_TRUE(IsEqual(10.0, x.min()));
+    EXPECT_TRUE(IsEqual(13.0, x.max()));
+    EXPECT_EQ(0, x.toPixel(10.0));
+    EXPECT_EQ(1600, x.toPixel(13.0));
+}
+
+TEST(Report, scan)
+{
+    // clipped at -5 and 5, flatlines from 3 equal samples
+    std::vector<int> samples = {0, 1, 5, 5, 5, 2, -5, 3, 3, 4, 4, 4, 4, 1};
+    const MemoryStore store{std::vector<int>(samples)};
+    const Report::Stats stats = Report::Scan(store, 0, store.size(), -5, 5, 3);
+    EXPECT_EQ(14, stats.lsb.count);
+    EXPECT_EQ(-5, stats.lsb.min);
+    EXPECT_EQ(5, stats.lsb.max);
+    EXPECT_EQ(4, stats.clipped);
+    EXPECT_EQ(7, stats.flatline);
+    EXPECT_EQ(4, stats.longest);
+
+    const Report::Stats part = Report::Scan(store, 3, 9, -5, 5, 3);
+    EXPECT_EQ(6, part.lsb.count);
+    EXPECT_EQ(0, part.flatline);
+    EXPECT_EQ(2, part.longest);
+}
+
+TEST(Report, rawSamples)
+{
+    // equal files clipped at the start: their difference is 0 everywhere
+    QTemporaryDir dir;
+
+    for (auto name:{"/a.dat", "/b.dat"})
+    {
+        QFile file(dir.path() + name);
+        EXPECT_TRUE(file.open(QIODevice::WriteOnly));
+        QDataStream out(&file);
+        for (int index = 0; index < 200; ++index) {out << static_cast<qint16>((index < 60) ? 32767 : index % 7);}
+    }
+
+    const QString name = dir.path() + "/clipped.info";
+    QFile info(name);
+    EXPECT_TRUE(info.open(QIODevice::WriteOnly));
+    info.write("a.dat 500 1 mV \"A\" gain=0.005\n");
+    info.write("-b.dat 500 1 mV \"B\" gain=0.005\n");
+    info.close();
+
+    const DataMain data(name);
+    EXPECT_TRUE(data.valid());
+    const DataFile & difference = data.channels()[0].files()[0];
+    const Report::Stats stats = Report::Scan(difference, 0, difference.sampleCount());
+    EXPECT_EQ(200, stats.lsb.count);
+    EXPECT_EQ(0, stats.lsb.min);
+    EXPECT_EQ(0, stats.lsb.max);
+    EXPECT_EQ(60, stats.clipped);
+    EXPECT_EQ(60, stats.flatline);
+    EXPECT_EQ(60, stats.longest);
 }
 
 TEST(UnitScale, xy)
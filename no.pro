@@ -11,7 +11,7 @@ DEFINES = IS_RELEASE_BUILD
 DEFINES += QT_NO_DEBUG_OUTPUT
 }
 
-QT += widgets
+QT += widgets concurrent
 QMAKE_CXXFLAGS += -Wall -Wextra -pedantic
 SOURCES += main.cpp
 INCLUDEPATH += /home/m5/sw/utility/Current/include